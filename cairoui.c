@@ -106,7 +106,7 @@
  *
  * all windows and labels access arbitrary data stored as the pointer-to-void
  * field cairoui->cb; besides windows and labels, the cairoui structure
- * contains four callback functions:
+ * contains five callback functions:
  *
  * void draw(struct cairoui *cairoui);
  *	draw the document
@@ -120,6 +120,13 @@
  * int external(struct cairoui *cairoui, int window);
  *	called when a command is received from the fifo cairoui->command.fd;
  *	the received command is cairoui->command.command
+ *
+ * int idle(struct cairoui *cairoui);
+ *	called repeatedly while waiting for input, unless the timeout is zero;
+ *	it does a short step of work that can be done in advance and returns
+ *	whether more remains; input is checked after each step, and the
+ *	timeout is decreased by the time the steps take; setting
+ *	cairoui->redraw has the document redrawn as if the screen was exposed
  */
 
 /*
@@ -133,6 +140,7 @@
  *
  * 2. receive input
  *	actual input is read only if c == KEY_NONE
+ *	the idle function runs while waiting for it
  *	input may be KEY_TIMEOUT, KEY_REDRAW, etc. (see below)
  *	in some cases this step ends with a "continue" to skip step 3
  *
@@ -883,6 +891,10 @@ int cairoui_nopexternal(struct cairoui *cairoui, int window) {
 	(void) window;
 	return 0;
 }
+int cairoui_nopidle(struct cairoui *cairoui) {
+	(void) cairoui;
+	return FALSE;
+}
 
 /*
  * cairoui structure defaults
@@ -898,6 +910,7 @@ void cairoui_default(struct cairoui *cairoui) {
 	cairoui->resize = cairoui_nop;
 	cairoui->update = cairoui_nop;
 	cairoui->external = cairoui_nopexternal;
+	cairoui->idle = cairoui_nopidle;
 	cairoui->windowlist = emptywindowlist;
 	cairoui->labellist = emptylabellist;
 
@@ -1036,6 +1049,35 @@ void handler(int s) {
 	sig_reload = TRUE;
 }
 
+/*
+ * wait for input, running the idle function meanwhile
+ */
+int cairoui_input(struct cairoui *cairoui, struct command *command) {
+	struct cairodevice *cairodevice = cairoui->cairodevice;
+	int timeout = cairoui->timeout;
+	struct timespec start, end;
+	int c, elapsed;
+
+	while (timeout != 0 && cairodevice->isactive(cairodevice)) {
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		if (! cairoui->idle(cairoui))
+			break;
+		if (cairoui->redraw)
+			return KEY_REDRAW;
+		clock_gettime(CLOCK_MONOTONIC, &end);
+		if (timeout != NO_TIMEOUT) {
+			elapsed = (end.tv_sec - start.tv_sec) * 1000 +
+				(end.tv_nsec - start.tv_nsec) / 1000000;
+			timeout = timeout > elapsed ? timeout - elapsed : 0;
+		}
+		c = cairodevice->input(cairodevice, 0, command);
+		if (c != KEY_TIMEOUT)
+			return c;
+	}
+
+	return cairodevice->input(cairodevice, timeout, command);
+}
+
 /*
  * main loop
  */
@@ -1113,8 +1155,7 @@ void cairoui_main(struct cairoui *cairoui, int firstwindow) {
 		else {
 			pending = cairoui->timeout != NO_TIMEOUT &&
 				cairoui->timeout != 0;
-			c = cairodevice->input(cairodevice,
-				cairoui->timeout, command);
+			c = cairoui_input(cairoui, command);
 			if (c != KEY_REDRAW)
 				cairoui->timeout = NO_TIMEOUT;
 			cairoui_logstatus(LEVEL_MAIN, "postinput",
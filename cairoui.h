@@ -87,6 +87,9 @@ struct cairoui {
 
 	/* external command */
 	int (*external)(struct cairoui *cairoui, int window);
+
+	/* a step of background work while waiting for input */
+	int (*idle)(struct cairoui *cairoui);
 };
 
 /*
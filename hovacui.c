@@ -38,7 +38,6 @@
  * - lines of previous and next scroll: where the top or bottom of the screen
  *   were before the last scroll, or will be after scrolling up or down
  * - stack of windows; a window returns WINDOW_PREVIOUS to go back
- * - cache the textarea list of pages already scanned
  * - config opt "nolabel" for no label at all: skip the label part from draw()
  * - multiple files, list()-based window; return WINDOW_FILE+n to tell main()
  *   which file to switch to; and/or have a field in struct output for the new
@@ -77,9 +76,6 @@
  *   in general (see below); it can however be done by the same system of the
  *   next or previous anchor used for annotations and links
  * - prefer showing white area outside bounding box than outside page
- * - thread for page rendering, so that the ui remains responsive even on
- *   complex pages; the page and the ui render on different surfaces, that are
- *   then copied to the output
  * - thread for progress indicator: tells that the program is still working,
  *   and nothing is shown because rendering or saving is in progress
  *
@@ -209,7 +205,12 @@
  * - keyscript(), if the script requests a reload
  *
  * file changes are detected via poppler_document_get_id(), but this only works
- * after trying to render the document; this is why detection is done in draw()
+ * after trying to render the document; this is why detection is done in draw();
+ * a page is rendered only when it or its scale changes (see the note on
+ * rendered pages), not at each scroll; when the render thread is enabled,
+ * position->doc is not rendered at all: the thread checks its own document
+ * after each render and sets a flag that draw() reads; draw() is called again
+ * when the thread completes (see prefetch())
  *
  * this means that the document is automatically reloaded when switching into
  * the virtual terminal and when moving in the document; it is not reloaded
@@ -228,6 +229,34 @@
  *	and parsed by reloadpdf() after loading
  */
 
+/*
+ * note: rendered pages
+ *
+ * poppler renders the page into an image as large as the whole page at the
+ * scale of the current transformation; draw() then copies the image on the
+ * screen shifted by the translation, which is what scrolling changes; the
+ * page is rendered again only when the page or the scale change
+ *
+ * the last two images are kept in position->cached->rendered, the one
+ * currently shown first; the second is the page shown before, or the next
+ * page rendered in advance by prefetch() when waiting for input, at the scale
+ * of its first textbox (or last, if moving backwards); switching between two
+ * pages copies their images without rendering them
+ *
+ * night mode is applied to the screen after copying, so it does not require
+ * rendering the page again; a transformation that rotates disables the
+ * images: the page is rendered directly on the screen
+ *
+ * an image much larger than the screen (a poster-sized page, or a high zoom
+ * with fit=none) is not made; the page is instead divided in square tiles of
+ * TILESIZE pixels at the current scale, and only the tiles that intersect
+ * output->dest are drawn; the ones not already in position->cached->tile are
+ * rendered together as a single image, then cut; the tiles are kept for
+ * twice the screen, the least recently used dropped first; this way, both the
+ * memory and the time for rendering depend on the size of the screen and not
+ * on that of the page
+ */
+
 /*
  * note: the minwidth
  *
@@ -425,6 +454,7 @@
 
 #define MIN(a,b) (((a) < (b)) ? (a) : (b))
 #define MAX(a,b) (((a) > (b)) ? (a) : (b))
+#define ROUND(a) ((int) ((a) < 0 ? (a) - 0.5 : (a) + 0.5))
 #undef clear
 
 /*
@@ -524,6 +554,71 @@ struct output {
 
 	/* enable the cache file */
 	gboolean cachefile;
+
+	/* number of pages kept in memory with their textarea */
+	int cachedpages;
+
+	/* pages read in advance in the direction of travel */
+	int prefetch;
+
+	/* render pages in a separate thread; the current is not yet shown */
+	gboolean renderthread;
+	gboolean rendering;
+};
+
+/*
+ * a page recently read, with its textarea for some viewmode, order, distance
+ * and textarea method
+ */
+struct cachedpage {
+	int npage;
+	PopplerPage *page;
+
+	int viewmode;
+	int order;
+	int distance;
+	int method;
+	RectangleList *textarea;
+	PopplerRectangle *boundingbox;
+};
+
+/*
+ * a page rendered to an image at some scale; the image is then copied to the
+ * screen instead of rendering the page again when only the scroll changes
+ */
+struct renderedpage {
+	PopplerPage *page;
+	double xscale, yscale;
+	cairo_surface_t *surface;
+};
+
+/*
+ * a square of a page rendered at some scale, for pages too large to be
+ * rendered whole
+ */
+#define TILESIZE 256
+struct tile {
+	PopplerPage *page;
+	double xscale, yscale;
+	int x, y;
+	cairo_surface_t *surface;
+};
+
+/*
+ * the pages recently read, least recently used first; the pages last
+ * rendered, the current first; the tiles recently drawn, least recently used
+ * first; shared by the temporary positions used for scanning the document
+ */
+#define RENDEREDPAGES 2
+struct cachedpages {
+	struct cachedpage *entry;
+	int num, max;
+
+	struct renderedpage rendered[RENDEREDPAGES];
+	struct renderer *renderer;
+
+	struct tile *tile;
+	int ntiles, maxtiles;
 };
 
 /*
@@ -542,12 +637,16 @@ struct position {
 
 	/* the text rectangle currently viewed, all of them in the page */
 	RectangleList *textarea;
+	RectangleHierarchy *hierarchy;
 	int box;
 	PopplerRectangle *viewbox;
 
 	/* how much the viewbox is moved before being displayed */
 	double scrollx;
 	double scrolly;
+
+	/* the pages recently read */
+	struct cachedpages *cached;
 };
 
 /*
@@ -570,6 +669,7 @@ void initposition(struct position *position) {
 	position->page = NULL;
 	position->boundingbox = NULL;
 	position->textarea = NULL;
+	position->hierarchy = NULL;
 	position->box = 0;
 	position->viewbox = NULL;
 	position->scrollx = 0;
@@ -658,17 +758,229 @@ int pagematch(struct position *position, struct output *output) {
 }
 
 /*
- * read the current page without its textarea
+ * free the textarea of a cached page
  */
-int readpageraw(struct position *position, struct output *output) {
-	g_clear_object(&position->page);
-	position->page =
-		poppler_document_get_page(position->doc, position->npage);
-	pagematch(position, output);
-	freeglistrectangles(output->selection);
-	output->selection = NULL;
-	setcurrent(&output->current, CURRENT_NONE);
-	return 0;
+void cachedtextareafree(struct cachedpage *cached) {
+	rectanglelist_free(cached->textarea);
+	cached->textarea = NULL;
+	poppler_rectangle_free(cached->boundingbox);
+	cached->boundingbox = NULL;
+}
+
+/*
+ * empty the cache of pages; the pages are unreferenced, so that closing the
+ * document finalizes them
+ */
+void cachedpagesclear(struct cachedpages *cached) {
+	int i;
+	for (i = 0; i < cached->num; i++) {
+		cachedtextareafree(&cached->entry[i]);
+		g_clear_object(&cached->entry[i].page);
+	}
+	cached->num = 0;
+}
+
+/*
+ * find a page in the cache and make it the most recently used; NULL if not
+ * there
+ */
+struct cachedpage *cachedpagefind(struct cachedpages *cached, int npage) {
+	struct cachedpage found;
+	int i;
+
+	for (i = cached->num - 1; i >= 0; i--)
+		if (cached->entry[i].npage == npage)
+			break;
+	if (i < 0)
+		return NULL;
+
+	found = cached->entry[i];
+	memmove(&cached->entry[i], &cached->entry[i + 1],
+		(cached->num - i - 1) * sizeof(struct cachedpage));
+	cached->entry[cached->num - 1] = found;
+	return &cached->entry[cached->num - 1];
+}
+
+/*
+ * get a page, from the cache if there; otherwise read it and store it in the
+ * cache in place of the least recently used
+ */
+PopplerPage *cachedpage(struct position *position, int npage) {
+	struct cachedpages *cached = position->cached;
+	struct cachedpage *c;
+	PopplerPage *page;
+
+	if (cached->max <= 0)
+		return poppler_document_get_page(position->doc, npage);
+
+	c = cachedpagefind(cached, npage);
+	if (c != NULL)
+		return g_object_ref(c->page);
+
+	page = poppler_document_get_page(position->doc, npage);
+	if (page == NULL)
+		return NULL;
+
+	if (cached->num >= cached->max) {
+		cachedtextareafree(&cached->entry[0]);
+		g_clear_object(&cached->entry[0].page);
+		memmove(&cached->entry[0], &cached->entry[1],
+			(cached->num - 1) * sizeof(struct cachedpage));
+		cached->num--;
+	}
+	c = &cached->entry[cached->num++];
+	c->npage = npage;
+	c->page = g_object_ref(page);
+	c->textarea = NULL;
+	c->boundingbox = NULL;
+	return page;
+}
+
+/*
+ * the cache entry of the current page if its textarea was computed with the
+ * current settings
+ */
+struct cachedpage *cachedtextarea(struct position *position,
+		struct output *output) {
+	struct cachedpage *c;
+
+	c = cachedpagefind(position->cached, position->npage);
+	if (c == NULL || c->page != position->page || c->textarea == NULL)
+		return NULL;
+	if (c->viewmode != output->viewmode ||
+	    c->order != output->order ||
+	    c->distance != output->distance ||
+	    c->method != textareamethod)
+		return NULL;
+	return c;
+}
+
+/*
+ * store the textarea of the current page in the cache, replacing the one
+ * computed with other settings, if any
+ */
+void cachedtextareastore(struct position *position, struct output *output) {
+	struct cachedpage *c;
+
+	c = cachedpagefind(position->cached, position->npage);
+	if (c == NULL || c->page != position->page)
+		return;
+	cachedtextareafree(c);
+	c->viewmode = output->viewmode;
+	c->order = output->order;
+	c->distance = output->distance;
+	c->method = textareamethod;
+	c->textarea = rectanglelist_copy(position->textarea);
+	c->boundingbox = poppler_rectangle_copy(position->boundingbox);
+}
+
+/*
+ * free a rendered page
+ */
+void renderedpagefree(struct renderedpage *rendered) {
+	g_clear_object(&rendered->page);
+	if (rendered->surface != NULL)
+		cairo_surface_destroy(rendered->surface);
+	rendered->surface = NULL;
+}
+
+/*
+ * whether a page is rendered to images at the scale of a matrix, in tiles or
+ * whole; not if the matrix rotates; tiles if the page would be much larger
+ * than the screen
+ */
+gboolean tileable(cairo_matrix_t *m) {
+	return m->xy == 0 && m->yx == 0 && m->xx > 0 && m->yy > 0;
+}
+gboolean renderable(PopplerPage *page, cairo_matrix_t *m,
+		struct output *output) {
+	double width, height;
+
+	if (! tileable(m))
+		return FALSE;
+	poppler_page_get_size(page, &width, &height);
+	width *= m->xx;
+	height *= m->yy;
+	return width < 32767 && height < 32767 &&
+		width * height <
+			8 * output->screenwidth * output->screenheight;
+}
+
+/*
+ * index of a page rendered at the scale of a matrix, -1 if none
+ */
+int renderedpagefind(struct cachedpages *cached, PopplerPage *page,
+		cairo_matrix_t *m) {
+	struct renderedpage *r = cached->rendered;
+	int i;
+
+	for (i = 0; i < RENDEREDPAGES; i++)
+		if (r[i].page == page &&
+		    r[i].xscale == m->xx && r[i].yscale == m->yy)
+			return i;
+	return -1;
+}
+
+/*
+ * render a page to an image at a scale
+ */
+cairo_surface_t *renderimage(PopplerPage *page, double xscale, double yscale) {
+	cairo_surface_t *surface;
+	double width, height;
+	cairo_t *cr;
+
+	poppler_page_get_size(page, &width, &height);
+	surface = cairo_image_surface_create(CAIRO_FORMAT_ARGB32,
+		(int) (width * xscale) + 1, (int) (height * yscale) + 1);
+	cr = cairo_create(surface);
+	cairo_scale(cr, xscale, yscale);
+	poppler_page_render(page, cr);
+	cairo_destroy(cr);
+	return surface;
+}
+
+/*
+ * store the image of a page in the given place of the rendered pages, moving
+ * the following ones up and dropping the last
+ */
+cairo_surface_t *renderedpagestore(struct cachedpages *cached,
+		PopplerPage *page, double xscale, double yscale,
+		cairo_surface_t *surface, int place) {
+	struct renderedpage *r = cached->rendered;
+
+	renderedpagefree(&r[RENDEREDPAGES - 1]);
+	memmove(&r[place + 1], &r[place],
+		(RENDEREDPAGES - 1 - place) * sizeof(struct renderedpage));
+
+	r[place].page = g_object_ref(page);
+	r[place].xscale = xscale;
+	r[place].yscale = yscale;
+	r[place].surface = surface;
+	return surface;
+}
+
+/*
+ * the image of a page at the scale of a matrix; rendered if not already, and
+ * in both cases moved in the given place of the rendered pages
+ */
+cairo_surface_t *renderedpage(struct cachedpages *cached, PopplerPage *page,
+		cairo_matrix_t *m, int place) {
+	struct renderedpage *r = cached->rendered, found;
+	int i;
+
+	i = renderedpagefind(cached, page, m);
+	if (i == -1)
+		return renderedpagestore(cached, page, m->xx, m->yy,
+			renderimage(page, m->xx, m->yy), place);
+
+	if (i > place) {
+		found = r[i];
+		memmove(&r[place + 1], &r[place],
+			(i - place) * sizeof(struct renderedpage));
+		r[place] = found;
+		return r[place].surface;
+	}
+	return r[i].surface;
 }
 
 /*
@@ -721,34 +1033,48 @@ double interoverlap(struct position *position) {
 }
 
 /*
- * determine the textarea of the current page
+ * compute the textarea and the bounding box of the page of a position, which
+ * is all that is used of it; also called by the render thread on its own
+ * document, so it does not depend on the output
  */
-int textarea(struct position *position, struct output *output) {
-	void (*order[])(RectangleList *, PopplerPage *) = {
-		rectanglelist_quicksort,
-		rectanglelist_twosort,
-		rectanglelist_charsort
-	};
+void textareacompute(struct position *position,
+		int viewmode, int order, int distance) {
+	PageText *pagetext;
 	double overlap, frag;
 
-	if (! POPPLER_IS_PAGE(position->page)) {
-		*output->reload = TRUE;
-		return -1;
-	}
-
-	rectanglelist_free(position->textarea);
-	poppler_rectangle_free(position->boundingbox);
-
-	switch (output->viewmode) {
+	switch (viewmode) {
 	case 0:
 	case 1:
-		position->textarea =
-			rectanglelist_textarea_distance(position->page,
-				output->distance);
+		/* text and layout are read once for textarea and sorting */
+		pagetext = pagetext_new(position->page);
+		if (textareamethod != 2) {
+			position->textarea =
+				rectanglelist_textarea_distance_pagetext(
+					pagetext, distance);
+		}
+		else {
+			/* the hierarchy is kept until the page changes, so that
+			 * changing the distance does not require reading the
+			 * page again */
+			if (position->hierarchy != NULL &&
+			    position->hierarchy->maxdistance < distance) {
+				rectanglehierarchy_free(position->hierarchy);
+				position->hierarchy = NULL;
+			}
+			if (position->hierarchy == NULL)
+				position->hierarchy =
+					rectanglehierarchy_new_pagetext(
+						pagetext,
+						MAX(2 * distance, 30));
+			position->textarea =
+				rectanglehierarchy_cut(position->hierarchy,
+					distance);
+		}
 		if (position->textarea->num == 0) {
 			rectanglelist_free(position->textarea);
 			position->textarea = NULL;
 			position->boundingbox = NULL;
+			pagetext_free(pagetext);
 			break;
 		}
 		position->boundingbox =
@@ -757,12 +1083,15 @@ int textarea(struct position *position, struct output *output) {
 		frag = fragmented(position);
 		// ensureoutputfile(output);
 		// fprintf(output->outfile, "auto: %g %g\n", overlap, frag);
-		if (output->viewmode == 0 && (overlap < 0.8 || frag > 1.0)) {
+		if (viewmode == 0 && (overlap < 0.8 || frag > 1.0)) {
 			rectanglelist_free(position->textarea);
 			position->textarea = NULL;
+			pagetext_free(pagetext);
 			break;
 		}
-		order[output->order](position->textarea, position->page);
+		rectanglelist_sort_pagetext(position->textarea, pagetext,
+			order);
+		pagetext_free(pagetext);
 		break;
 	case 2:
 #if POPPLER_CHECK_VERSION(0, 90, 0)
@@ -786,7 +1115,625 @@ int textarea(struct position *position, struct output *output) {
 		position->textarea = rectanglelist_new(1);
 		rectanglelist_add(position->textarea, position->boundingbox);
 	}
+}
 
+/*
+ * the render thread: renders the pages to images on its own copy of the
+ * document, so that the interface is not blocked meanwhile; a request
+ * replaces the previous if not yet started; a render completed when a newer
+ * is requested is dropped
+ *
+ * when no render is requested, it also computes the textareas of the pages
+ * read in advance by prefetch(), with the same rules; a render requested
+ * meanwhile waits for the textarea being computed
+ */
+struct renderer {
+	GThread *thread;
+	GMutex mutex;
+	GCond cond;
+	PopplerDocument *doc;
+	gboolean quit;
+
+	/* the requested page and scale */
+	gboolean requested;
+	int npage;
+	double xscale, yscale;
+
+	/* whether rendering is in progress */
+	gboolean busy;
+
+	/* the last image rendered, not yet taken */
+	cairo_surface_t *surface;
+	int snpage;
+	double sxscale, syscale;
+
+	/* whether the file changed, checked after each render */
+	gchar *update_id;
+	gboolean changed;
+
+	/* the page whose textarea is requested (npage -1 = none) and the
+	 * settings for it; the page whose textarea is being computed (-1 =
+	 * none); the last textarea computed, not yet taken */
+	struct cachedpage tarequest;
+	int tanpage;
+	struct cachedpage taresult;
+
+	/* the page and scale last requested by prefetchrender(); only used by
+	 * the main thread */
+	int prefetched;
+	double pxscale, pyscale;
+};
+
+/*
+ * compute the requested textarea in the render thread, called and returning
+ * with the mutex locked
+ */
+void renderertextareathread(struct renderer *renderer) {
+	struct cachedpage request;
+	struct position scan;
+
+	request = renderer->tarequest;
+	renderer->tarequest.npage = -1;
+	renderer->tanpage = request.npage;
+	renderer->busy = TRUE;
+	g_mutex_unlock(&renderer->mutex);
+
+	initposition(&scan);
+	scan.npage = request.npage;
+	scan.page = poppler_document_get_page(renderer->doc, request.npage);
+	request.method = textareamethod;
+	if (scan.page != NULL)
+		textareacompute(&scan,
+			request.viewmode, request.order, request.distance);
+	request.page = NULL;
+	request.textarea = scan.textarea;
+	request.boundingbox = scan.boundingbox;
+	rectanglehierarchy_free(scan.hierarchy);
+	g_clear_object(&scan.page);
+
+	g_mutex_lock(&renderer->mutex);
+	renderer->busy = FALSE;
+	renderer->tanpage = -1;
+	/* a page missing in the document of the thread: the file changed */
+	if (request.textarea == NULL)
+		renderer->changed = TRUE;
+	if (request.textarea != NULL && renderer->tarequest.npage != -1)
+		cachedtextareafree(&request);
+	else if (request.textarea != NULL) {
+		cachedtextareafree(&renderer->taresult);
+		renderer->taresult = request;
+	}
+	g_cond_broadcast(&renderer->cond);
+}
+
+/*
+ * the render thread loop
+ */
+gpointer rendererthread(gpointer data) {
+	struct renderer *renderer = data;
+	PopplerPage *page;
+	cairo_surface_t *surface;
+	int npage;
+	double xscale, yscale;
+	gchar *update_id;
+	gboolean changed;
+
+	pagecache_document(renderer->doc);
+
+	g_mutex_lock(&renderer->mutex);
+	while (! renderer->quit) {
+		if (! renderer->requested && renderer->tarequest.npage != -1) {
+			renderertextareathread(renderer);
+			continue;
+		}
+		if (! renderer->requested) {
+			g_cond_wait(&renderer->cond, &renderer->mutex);
+			continue;
+		}
+		npage = renderer->npage;
+		xscale = renderer->xscale;
+		yscale = renderer->yscale;
+		renderer->requested = FALSE;
+		renderer->busy = TRUE;
+		g_mutex_unlock(&renderer->mutex);
+
+		page = poppler_document_get_page(renderer->doc, npage);
+		surface = page == NULL ? NULL :
+			renderimage(page, xscale, yscale);
+		g_clear_object(&page);
+
+		/* same as changedpdf(), on the document of the thread */
+		changed = FALSE;
+		if (poppler_document_get_id(renderer->doc, NULL, &update_id)) {
+			if (renderer->update_id == NULL)
+				renderer->update_id = update_id;
+			else {
+				changed = ! ! memcmp(renderer->update_id,
+					update_id, 32);
+				g_free(update_id);
+			}
+		}
+
+		g_mutex_lock(&renderer->mutex);
+		renderer->busy = FALSE;
+		renderer->changed = renderer->changed || changed;
+		if (surface != NULL && renderer->requested)
+			cairo_surface_destroy(surface);
+		else if (surface != NULL) {
+			if (renderer->surface != NULL)
+				cairo_surface_destroy(renderer->surface);
+			renderer->surface = surface;
+			renderer->snpage = npage;
+			renderer->sxscale = xscale;
+			renderer->syscale = yscale;
+		}
+		g_cond_broadcast(&renderer->cond);
+	}
+	g_mutex_unlock(&renderer->mutex);
+
+	return NULL;
+}
+
+/*
+ * start the render thread on a document; NULL if it cannot be opened
+ */
+struct renderer *renderernew(char *filename) {
+	struct renderer *renderer;
+	PopplerDocument *doc;
+	char *uri;
+
+	uri = filenametouri(filename);
+	if (uri == NULL)
+		return NULL;
+	doc = poppler_document_new_from_file(uri, NULL, NULL);
+	free(uri);
+	if (doc == NULL)
+		return NULL;
+
+	renderer = malloc(sizeof(struct renderer));
+	g_mutex_init(&renderer->mutex);
+	g_cond_init(&renderer->cond);
+	renderer->doc = doc;
+	renderer->quit = FALSE;
+	renderer->requested = FALSE;
+	renderer->busy = FALSE;
+	renderer->surface = NULL;
+	renderer->update_id = NULL;
+	renderer->changed = FALSE;
+	renderer->tarequest.npage = -1;
+	renderer->tanpage = -1;
+	renderer->taresult.textarea = NULL;
+	renderer->taresult.boundingbox = NULL;
+	renderer->prefetched = -1;
+	renderer->thread = g_thread_new("render", rendererthread, renderer);
+	return renderer;
+}
+
+/*
+ * stop the render thread, after the render in progress if any
+ */
+void rendererfree(struct renderer *renderer) {
+	if (renderer == NULL)
+		return;
+
+	g_mutex_lock(&renderer->mutex);
+	renderer->quit = TRUE;
+	g_cond_broadcast(&renderer->cond);
+	g_mutex_unlock(&renderer->mutex);
+	g_thread_join(renderer->thread);
+
+	if (renderer->surface != NULL)
+		cairo_surface_destroy(renderer->surface);
+	cachedtextareafree(&renderer->taresult);
+	g_free(renderer->update_id);
+	g_object_unref(renderer->doc);
+	g_cond_clear(&renderer->cond);
+	g_mutex_clear(&renderer->mutex);
+	free(renderer);
+}
+
+/*
+ * request a page to be rendered at the scale of a matrix
+ */
+void rendererrequest(struct renderer *renderer, int npage,
+		cairo_matrix_t *m) {
+	g_mutex_lock(&renderer->mutex);
+	renderer->requested = TRUE;
+	renderer->npage = npage;
+	renderer->xscale = m->xx;
+	renderer->yscale = m->yy;
+	g_cond_broadcast(&renderer->cond);
+	g_mutex_unlock(&renderer->mutex);
+}
+
+/*
+ * request the textarea of a page with the current settings
+ */
+void renderertextarea(struct renderer *renderer, int npage,
+		struct output *output) {
+	g_mutex_lock(&renderer->mutex);
+	renderer->tarequest.npage = npage;
+	renderer->tarequest.viewmode = output->viewmode;
+	renderer->tarequest.order = output->order;
+	renderer->tarequest.distance = output->distance;
+	renderer->tarequest.method = textareamethod;
+	g_cond_broadcast(&renderer->cond);
+	g_mutex_unlock(&renderer->mutex);
+}
+
+/*
+ * drop the request of a textarea, if not yet started
+ */
+void rendererdroptextarea(struct renderer *renderer) {
+	if (renderer == NULL)
+		return;
+	g_mutex_lock(&renderer->mutex);
+	renderer->tarequest.npage = -1;
+	g_mutex_unlock(&renderer->mutex);
+}
+
+/*
+ * wait for the render thread to complete the textarea of a page, if it is
+ * computing it; drop it if only requested
+ */
+void renderertextareawait(struct renderer *renderer, int npage) {
+	g_mutex_lock(&renderer->mutex);
+	if (renderer->tarequest.npage == npage)
+		renderer->tarequest.npage = -1;
+	while (renderer->tanpage == npage)
+		g_cond_wait(&renderer->cond, &renderer->mutex);
+	g_mutex_unlock(&renderer->mutex);
+}
+
+/*
+ * whether the render thread is working or has a request to
+ */
+gboolean rendererbusy(struct renderer *renderer) {
+	gboolean busy;
+
+	g_mutex_lock(&renderer->mutex);
+	busy = renderer->requested || renderer->busy ||
+		renderer->tarequest.npage != -1;
+	g_mutex_unlock(&renderer->mutex);
+	return busy;
+}
+
+/*
+ * whether the render thread found the file changed
+ */
+gboolean rendererchanged(struct renderer *renderer) {
+	gboolean changed;
+
+	if (renderer == NULL)
+		return FALSE;
+	g_mutex_lock(&renderer->mutex);
+	changed = renderer->changed;
+	g_mutex_unlock(&renderer->mutex);
+	return changed;
+}
+
+/*
+ * wait at most some milliseconds for the render thread to complete its
+ * requests; return whether an image is ready
+ */
+gboolean rendererwait(struct renderer *renderer, int milliseconds) {
+	gint64 end;
+	gboolean ready;
+
+	end = g_get_monotonic_time() + milliseconds * G_TIME_SPAN_MILLISECOND;
+	g_mutex_lock(&renderer->mutex);
+	while (renderer->surface == NULL &&
+	       (renderer->requested || renderer->busy ||
+	        renderer->tarequest.npage != -1))
+		if (! g_cond_wait_until(&renderer->cond, &renderer->mutex, end))
+			break;
+	ready = renderer->surface != NULL;
+	g_mutex_unlock(&renderer->mutex);
+	return ready;
+}
+
+/*
+ * move the image from the render thread to the rendered pages; the current
+ * page first, the others second; return whether the image of the current page
+ * arrived
+ */
+gboolean renderertake(struct position *position) {
+	struct renderer *renderer = position->cached->renderer;
+	cairo_surface_t *surface;
+	PopplerPage *page;
+	int npage;
+	double xscale, yscale;
+
+	g_mutex_lock(&renderer->mutex);
+	surface = renderer->surface;
+	npage = renderer->snpage;
+	xscale = renderer->sxscale;
+	yscale = renderer->syscale;
+	renderer->surface = NULL;
+	g_mutex_unlock(&renderer->mutex);
+	if (surface == NULL)
+		return FALSE;
+
+	page = npage == position->npage && position->page != NULL ?
+		g_object_ref(position->page) : cachedpage(position, npage);
+	if (page == NULL) {
+		cairo_surface_destroy(surface);
+		return FALSE;
+	}
+	renderedpagestore(position->cached, page, xscale, yscale, surface,
+		page == position->page ? 0 : 1);
+	g_object_unref(page);
+	return npage == position->npage;
+}
+
+/*
+ * move the textarea computed by the render thread to the cache of pages, if
+ * the page is still there and the settings are the same; return whether a
+ * textarea arrived
+ */
+gboolean renderertaketextarea(struct position *position,
+		struct output *output) {
+	struct renderer *renderer = position->cached->renderer;
+	struct cachedpage result, *c;
+
+	g_mutex_lock(&renderer->mutex);
+	result = renderer->taresult;
+	renderer->taresult.textarea = NULL;
+	renderer->taresult.boundingbox = NULL;
+	g_mutex_unlock(&renderer->mutex);
+	if (result.textarea == NULL)
+		return FALSE;
+
+	c = cachedpagefind(position->cached, result.npage);
+	if (c == NULL ||
+	    result.viewmode != output->viewmode ||
+	    result.order != output->order ||
+	    result.distance != output->distance ||
+	    result.method != textareamethod) {
+		cachedtextareafree(&result);
+		return TRUE;
+	}
+	cachedtextareafree(c);
+	c->viewmode = result.viewmode;
+	c->order = result.order;
+	c->distance = result.distance;
+	c->method = result.method;
+	c->textarea = result.textarea;
+	c->boundingbox = result.boundingbox;
+	return TRUE;
+}
+
+/*
+ * the image of the current page, by the render thread if enabled; NULL if it
+ * is not ready within a short time
+ */
+cairo_surface_t *pageimage(struct position *position, struct output *output,
+		cairo_matrix_t *m) {
+	struct cachedpages *cached = position->cached;
+
+	if (! output->renderthread ||
+	    renderedpagefind(cached, position->page, m) != -1)
+		return renderedpage(cached, position->page, m, 0);
+
+	if (cached->renderer == NULL)
+		cached->renderer = renderernew(position->filename);
+	if (cached->renderer == NULL) {
+		output->renderthread = FALSE;
+		return renderedpage(cached, position->page, m, 0);
+	}
+
+	rendererrequest(cached->renderer, position->npage, m);
+	if (rendererwait(cached->renderer, 100))
+		renderertake(position);
+
+	if (renderedpagefind(cached, position->page, m) == -1)
+		return NULL;
+	return renderedpage(cached, position->page, m, 0);
+}
+
+/*
+ * free the tiles
+ */
+void tilesclear(struct cachedpages *cached) {
+	int i;
+	for (i = 0; i < cached->ntiles; i++) {
+		g_clear_object(&cached->tile[i].page);
+		cairo_surface_destroy(cached->tile[i].surface);
+	}
+	cached->ntiles = 0;
+}
+
+/*
+ * find a tile and make it the most recently used; NULL if not there
+ */
+struct tile *tilefind(struct cachedpages *cached, PopplerPage *page,
+		cairo_matrix_t *m, int x, int y) {
+	struct tile found, *t = cached->tile;
+	int i;
+
+	for (i = cached->ntiles - 1; i >= 0; i--)
+		if (t[i].page == page && t[i].x == x && t[i].y == y &&
+		    t[i].xscale == m->xx && t[i].yscale == m->yy)
+			break;
+	if (i < 0)
+		return NULL;
+
+	found = t[i];
+	memmove(&t[i], &t[i + 1],
+		(cached->ntiles - i - 1) * sizeof(struct tile));
+	t[cached->ntiles - 1] = found;
+	return &t[cached->ntiles - 1];
+}
+
+/*
+ * store a tile, in place of the least recently used if no space is left
+ */
+void tileadd(struct cachedpages *cached, PopplerPage *page,
+		cairo_matrix_t *m, int x, int y, cairo_surface_t *surface) {
+	struct tile *t = cached->tile;
+
+	if (cached->ntiles >= cached->maxtiles) {
+		g_clear_object(&t[0].page);
+		cairo_surface_destroy(t[0].surface);
+		memmove(&t[0], &t[1],
+			(cached->ntiles - 1) * sizeof(struct tile));
+		cached->ntiles--;
+	}
+	t += cached->ntiles++;
+	t->page = g_object_ref(page);
+	t->xscale = m->xx;
+	t->yscale = m->yy;
+	t->x = x;
+	t->y = y;
+	t->surface = surface;
+}
+
+/*
+ * draw the page by the tiles that intersect the destination rectangle; the
+ * missing ones are rendered at once, in a single image then cut into tiles;
+ * enough tiles are kept for twice the screen
+ */
+void drawtiles(struct position *position, struct output *output,
+		cairo_matrix_t *m) {
+	struct cachedpages *cached = position->cached;
+	PopplerPage *page = position->page;
+	double width, height;
+	int max, ox, oy, x1, y1, x2, y2, x, y, mx1, my1, mx2, my2;
+	cairo_surface_t *block, *surface;
+	cairo_t *cr;
+	struct tile *t;
+
+	max = 2 * ((int) output->screenwidth / TILESIZE + 2) *
+		((int) output->screenheight / TILESIZE + 2);
+	if (cached->maxtiles != max) {
+		tilesclear(cached);
+		free(cached->tile);
+		cached->tile = malloc(max * sizeof(struct tile));
+		cached->maxtiles = max;
+	}
+
+	/* the tiles in the destination, in the page as rendered at the scale
+	 * of the matrix, which then begins at ox,oy in the screen */
+	poppler_page_get_size(page, &width, &height);
+	ox = ROUND(m->x0);
+	oy = ROUND(m->y0);
+	x1 = MAX(0, output->dest.x1 - ox);
+	y1 = MAX(0, output->dest.y1 - oy);
+	x2 = MIN(width * m->xx + 1, output->dest.x2 - ox);
+	y2 = MIN(height * m->yy + 1, output->dest.y2 - oy);
+	if (x1 >= x2 || y1 >= y2)
+		return;
+	x1 /= TILESIZE;
+	y1 /= TILESIZE;
+	x2 = (x2 - 1) / TILESIZE;
+	y2 = (y2 - 1) / TILESIZE;
+
+	mx1 = x2 + 1;
+	my1 = y2 + 1;
+	mx2 = x1 - 1;
+	my2 = y1 - 1;
+	for (y = y1; y <= y2; y++)
+		for (x = x1; x <= x2; x++)
+			if (tilefind(cached, page, m, x, y) == NULL) {
+				mx1 = MIN(mx1, x);
+				my1 = MIN(my1, y);
+				mx2 = MAX(mx2, x);
+				my2 = MAX(my2, y);
+			}
+
+	if (mx1 <= mx2) {
+		block = cairo_image_surface_create(CAIRO_FORMAT_ARGB32,
+			(mx2 - mx1 + 1) * TILESIZE, (my2 - my1 + 1) * TILESIZE);
+		cr = cairo_create(block);
+		cairo_translate(cr, -mx1 * TILESIZE, -my1 * TILESIZE);
+		cairo_scale(cr, m->xx, m->yy);
+		poppler_page_render(page, cr);
+		cairo_destroy(cr);
+
+		for (y = my1; y <= my2; y++)
+			for (x = mx1; x <= mx2; x++) {
+				if (tilefind(cached, page, m, x, y) != NULL)
+					continue;
+				surface = cairo_image_surface_create(
+					CAIRO_FORMAT_ARGB32,
+					TILESIZE, TILESIZE);
+				cr = cairo_create(surface);
+				cairo_set_source_surface(cr, block,
+					-(x - mx1) * TILESIZE,
+					-(y - my1) * TILESIZE);
+				cairo_paint(cr);
+				cairo_destroy(cr);
+				tileadd(cached, page, m, x, y, surface);
+			}
+
+		cairo_surface_destroy(block);
+	}
+
+	cairo_save(output->cr);
+	cairo_identity_matrix(output->cr);
+	for (y = y1; y <= y2; y++)
+		for (x = x1; x <= x2; x++) {
+			t = tilefind(cached, page, m, x, y);
+			if (t == NULL)
+				continue;
+			cairo_set_source_surface(output->cr, t->surface,
+				ox + x * TILESIZE, oy + y * TILESIZE);
+			cairo_rectangle(output->cr,
+				ox + x * TILESIZE, oy + y * TILESIZE,
+				TILESIZE, TILESIZE);
+			cairo_fill(output->cr);
+		}
+	cairo_restore(output->cr);
+}
+
+/*
+ * read the current page without its textarea
+ */
+int readpageraw(struct position *position, struct output *output) {
+	rendererdroptextarea(position->cached->renderer);
+	g_clear_object(&position->page);
+	rectanglehierarchy_free(position->hierarchy);
+	position->hierarchy = NULL;
+	position->page = cachedpage(position, position->npage);
+	pagematch(position, output);
+	freeglistrectangles(output->selection);
+	output->selection = NULL;
+	setcurrent(&output->current, CURRENT_NONE);
+	return 0;
+}
+
+/*
+ * determine the textarea of the current page
+ */
+int textarea(struct position *position, struct output *output) {
+	struct cachedpage *cached;
+
+	if (! POPPLER_IS_PAGE(position->page)) {
+		*output->reload = TRUE;
+		return -1;
+	}
+
+	rectanglelist_free(position->textarea);
+	poppler_rectangle_free(position->boundingbox);
+
+	/* the render thread may be computing it in advance */
+	if (position->cached->renderer != NULL) {
+		renderertextareawait(position->cached->renderer,
+			position->npage);
+		renderertaketextarea(position, output);
+	}
+
+	cached = cachedtextarea(position, output);
+	if (cached != NULL) {
+		position->textarea = rectanglelist_copy(cached->textarea);
+		position->boundingbox =
+			poppler_rectangle_copy(cached->boundingbox);
+		return 0;
+	}
+
+	textareacompute(position,
+		output->viewmode, output->order, output->distance);
+	cachedtextareastore(position, output);
 	return 0;
 }
 
@@ -1982,6 +2929,11 @@ int document(int c, struct cairoui *cairoui) {
 	struct output *output = OUTPUT(cairoui);
 	static gboolean labels;
 
+	/* the textarea prefetched is requested again when idle */
+	if (c != KEY_INIT && c != KEY_TIMEOUT &&
+	    c != KEY_REFRESH && c != KEY_FINISH)
+		rendererdroptextarea(position->cached->renderer);
+
 	switch (c) {
 	case 'r':
 		cairoui->reload = TRUE;
@@ -2869,7 +3821,7 @@ int textdistance(int c, struct cairoui *cairoui) {
 		"text distance: ", distancestring, &pos, NULL,
 		&output->distance, 0, 1000);
 	if (res == CAIROUI_DONE) {
-		readpage(position, output);
+		textarea(position, output);
 		firsttextbox(position, output);
 		return output->immediate ? CAIROUI_REFRESH : WINDOW_DOCUMENT;
 	}
@@ -3209,6 +4161,18 @@ void filename(struct cairoui *cairoui) {
 	output->filename = FALSE;
 }
 
+/*
+ * the page is being rendered
+ */
+void rendering(struct cairoui *cairoui) {
+	struct output *output = OUTPUT(cairoui);
+
+	if (! output->rendering)
+		return;
+
+	cairoui_label(cairoui, "rendering...", 6);
+}
+
 /*
  * list of labels
  */
@@ -3218,6 +4182,7 @@ void (*labellist[])(struct cairoui *) = {
 	showmode,
 	showfit,
 	filename,
+	rendering,
 	NULL
 };
 
@@ -3276,6 +4241,155 @@ int changedpdf(struct position *position) {
 	return res;
 }
 
+/*
+ * render in advance the following page in the direction of travel, as it is
+ * shown when moving to it; by the render thread if running; return whether
+ * something was done
+ */
+int prefetchrender(struct position *position, struct output *output,
+		int direction) {
+	struct renderer *renderer = position->cached->renderer;
+	struct position scan;
+	cairo_matrix_t current, m;
+	int n, res;
+
+	n = position->npage + direction;
+	if (n < 0 || n >= position->totpages)
+		return FALSE;
+
+	scan = *position;
+	scan.npage = n;
+	scan.page = cachedpage(&scan, n);
+	if (scan.page == NULL)
+		return FALSE;
+	scan.textarea = NULL;
+	scan.boundingbox = NULL;
+	scan.hierarchy = NULL;
+	scan.viewbox = NULL;
+	textarea(&scan, output);
+
+	cairo_get_matrix(output->cr, &current);
+	if (direction > 0)
+		firsttextbox(&scan, output);
+	else
+		lasttextbox(&scan, output);
+	cairo_get_matrix(output->cr, &m);
+	cairo_set_matrix(output->cr, &current);
+
+	res = FALSE;
+	if (! renderable(scan.page, &m, output) ||
+	    renderedpagefind(position->cached, scan.page, &m) != -1) {
+		if (renderer != NULL)
+			renderer->prefetched = -1;
+	}
+	else if (renderer == NULL) {
+		renderedpage(position->cached, scan.page, &m, 1);
+		res = TRUE;
+	}
+	else if (rendererbusy(renderer)) {
+		rendererwait(renderer, 20);
+		res = TRUE;
+	}
+	else if (renderer->prefetched != n ||
+	         renderer->pxscale != m.xx || renderer->pyscale != m.yy) {
+		/* not again if the thread could not render it */
+		rendererrequest(renderer, n, &m);
+		renderer->prefetched = n;
+		renderer->pxscale = m.xx;
+		renderer->pyscale = m.yy;
+		res = TRUE;
+	}
+
+	rectanglelist_free(scan.textarea);
+	poppler_rectangle_free(scan.boundingbox);
+	rectanglehierarchy_free(scan.hierarchy);
+	poppler_rectangle_free(scan.viewbox);
+	g_object_unref(scan.page);
+	return res;
+}
+
+/*
+ * work done when waiting for input: take the image of the current page from
+ * the render thread and have it shown; read a page and its textarea in
+ * advance; the candidates are the pages following the current in the
+ * direction of travel, then the one preceding it; one page at each call, so
+ * that input is checked in between; return whether something was done
+ *
+ * with the render thread, the textarea is computed there, so that a long one
+ * does not delay input; meanwhile, this function only waits a short time for
+ * it, then returns
+ */
+int prefetch(struct cairoui *cairoui) {
+	struct position *position = POSITION(cairoui);
+	struct output *output = OUTPUT(cairoui);
+	static int prev = -1, direction = 1;
+	struct renderer *renderer = position->cached->renderer;
+	struct position scan;
+	int i, n, ahead;
+
+	/* the image of the current page comes first; draw() also reloads the
+	 * document if the thread found it changed */
+	if (renderer != NULL) {
+		if (renderertake(position) || rendererchanged(renderer)) {
+			cairoui->redraw = TRUE;
+			return TRUE;
+		}
+		if (output->rendering && rendererbusy(renderer)) {
+			rendererwait(renderer, 20);
+			return TRUE;
+		}
+		if (renderertaketextarea(position, output))
+			return TRUE;
+	}
+
+	if (output->prefetch <= 0 || position->cached->max < 2)
+		return FALSE;
+
+	if (position->npage != prev) {
+		direction = position->npage < prev ? -1 : 1;
+		prev = position->npage;
+	}
+
+	/* the current page is not evicted from the cache */
+	ahead = MIN(output->prefetch, position->cached->max - 2);
+	for (i = 1; i <= ahead + 1; i++) {
+		n = position->npage + (i <= ahead ? i * direction : -direction);
+		if (n < 0 || n >= position->totpages)
+			continue;
+
+		scan = *position;
+		scan.npage = n;
+		scan.page = cachedpage(&scan, n);
+		if (scan.page == NULL)
+			continue;
+		if (cachedtextarea(&scan, output) != NULL) {
+			g_object_unref(scan.page);
+			continue;
+		}
+
+		if (renderer != NULL) {
+			g_object_unref(scan.page);
+			if (rendererbusy(renderer))
+				rendererwait(renderer, 20);
+			else
+				renderertextarea(renderer, n, output);
+			return TRUE;
+		}
+
+		scan.textarea = NULL;
+		scan.boundingbox = NULL;
+		scan.hierarchy = NULL;
+		textarea(&scan, output);
+		rectanglelist_free(scan.textarea);
+		poppler_rectangle_free(scan.boundingbox);
+		rectanglehierarchy_free(scan.hierarchy);
+		g_object_unref(scan.page);
+		return TRUE;
+	}
+
+	return prefetchrender(position, output, direction);
+}
+
 /*
  * draw the page border
  */
@@ -3293,6 +4407,8 @@ void pageborder(struct position *position, struct output *output) {
 void draw(struct cairoui *cairoui) {
 	struct position *position = POSITION(cairoui);
 	struct output *output = OUTPUT(cairoui);
+	cairo_matrix_t m;
+	cairo_surface_t *surface;
 
 	moveto(position, output);
 	if (! POPPLER_IS_PAGE(position->page)) {
@@ -3301,7 +4417,25 @@ void draw(struct cairoui *cairoui) {
 		return;
 	}
 	cairoui_logstatus(LEVEL_DRAW, NULL, 0, cairoui, KEY_NONE);
-	poppler_page_render(position->page, output->cr);
+	cairo_get_matrix(output->cr, &m);
+	output->rendering = FALSE;
+	if (! tileable(&m))
+		poppler_page_render(position->page, output->cr);
+	else if (! renderable(position->page, &m, output))
+		drawtiles(position, output, &m);
+	else {
+		surface = pageimage(position, output, &m);
+		if (surface == NULL)
+			output->rendering = TRUE;
+		else {
+			cairo_save(output->cr);
+			cairo_identity_matrix(output->cr);
+			cairo_set_source_surface(output->cr, surface,
+				ROUND(m.x0), ROUND(m.y0));
+			cairo_paint(output->cr);
+			cairo_restore(output->cr);
+		}
+	}
 
 	if (output->night) {
 		cairo_set_source_rgb(output->cr, 1, 1, 1);
@@ -3311,8 +4445,9 @@ void draw(struct cairoui *cairoui) {
 		cairo_set_operator(output->cr, CAIRO_OPERATOR_OVER);
 	}
 
-	if (changedpdf(position)) {
-		cairoui->reload = TRUE;
+	if (changedpdf(position) ||
+	    rendererchanged(position->cached->renderer)) {
+		*output->reload = TRUE;
 		cairoui->redraw = TRUE;
 		return;
 	}
@@ -3379,10 +4514,11 @@ gchar *fakeid(char *filename) {
 /*
  * open a pdf file
  */
-struct position *openpdf(char *filename) {
+struct position *openpdf(char *filename, int cachedpages) {
 	char *uri;
 	struct position *position;
 	GError *err;
+	int i;
 
 	position = malloc(sizeof(struct position));
 
@@ -3412,8 +4548,24 @@ struct position *openpdf(char *filename) {
 		position->permanent_id = fakeid(position->filename);
 		position->update_id = fakeid(position->filename);
 	}
+	pagecache_document(position->doc);
 
 	position->page = NULL;
+	position->hierarchy = NULL;
+
+	position->cached = malloc(sizeof(struct cachedpages));
+	position->cached->max = cachedpages;
+	position->cached->num = 0;
+	position->cached->entry = cachedpages <= 0 ? NULL :
+		malloc(cachedpages * sizeof(struct cachedpage));
+	for (i = 0; i < RENDEREDPAGES; i++) {
+		position->cached->rendered[i].page = NULL;
+		position->cached->rendered[i].surface = NULL;
+	}
+	position->cached->renderer = NULL;
+	position->cached->tile = NULL;
+	position->cached->ntiles = 0;
+	position->cached->maxtiles = 0;
 
 	return position;
 }
@@ -3422,8 +4574,19 @@ struct position *openpdf(char *filename) {
  * close a pdf file
  */
 void closepdf(struct position *position) {
+	int i;
+
 	g_free(position->permanent_id);
 	g_free(position->update_id);
+	rectanglehierarchy_free(position->hierarchy);
+	cachedpagesclear(position->cached);
+	rendererfree(position->cached->renderer);
+	for (i = 0; i < RENDEREDPAGES; i++)
+		renderedpagefree(&position->cached->rendered[i]);
+	tilesclear(position->cached);
+	free(position->cached->tile);
+	free(position->cached->entry);
+	free(position->cached);
 	g_assert_finalize_object(position->page);
 	g_assert_finalize_object(position->doc);
 	free(position->filename);
@@ -3454,7 +4617,7 @@ void reloadpdf(struct cairoui *cairoui) {
 		output->nextfile = NULL;
 	}
 
-	new = openpdf(filename);
+	new = openpdf(filename, output->cachedpages);
 	if (new == NULL) {
 		cairoui_printlabel(cairoui, output->help,
 			2000, "failed loading %s", position->filename);
@@ -3588,6 +4751,27 @@ double fraction(char *arg) {
 	return atof(arg) / atof(col + 1);
 }
 
+/*
+ * scan a text distance, possibly preceded by the textarea algorithm "raster"
+ * or "hierarchy", like raster:12; return distance if none follows
+ */
+double textdistancearg(char *arg, double distance) {
+	char *methods[] = {"raster", "hierarchy"};
+	unsigned i;
+
+	textareamethod = 0;
+	for (i = 0; i < sizeof(methods) / sizeof(methods[0]); i++)
+		if (! strncmp(arg, methods[i], strlen(methods[i]))) {
+			textareamethod = i + 1;
+			arg += strlen(methods[i]);
+			if (*arg == ':')
+				arg++;
+			if (*arg == '\0')
+				return distance;
+		}
+	return atof(arg);
+}
+
 /*
  * usage
  */
@@ -3599,7 +4783,9 @@ void usage(char *additional) {
 	printf("\t\t-m viewmode\tzoom to: text, boundingbox, page\n");
 	printf("\t\t-f direction\tfit: horizontally, vertically, both\n");
 	printf("\t\t-w minwidth\tminimal width (maximal zoom)\n");
-	printf("\t\t-t distance\tminimal text distance\n");
+	printf("\t\t-t distance\tminimal text distance, raster:distance ");
+	printf("or\n\t\t\t\thierarchy:distance for faster ");
+	printf("approximate algorithms\n");
 	printf("\t\t-p\t\tpresentation mode\n");
 	printf("\t\t-s aspect\tthe screen aspect (e.g., 4:3)\n");
 	printf("\t\t-d device\tfbdev device, default /dev/fb0\n");
@@ -3645,6 +4831,7 @@ int hovacui(int argn, char *argv[], struct cairodevice *cairodevice) {
 	cairoui.resize = resize;
 	cairoui.update = reloadpdf;
 	cairoui.external = external;
+	cairoui.idle = prefetch;
 	cairoui.windowlist = windowlist;
 	cairoui.labellist = labellist;
 
@@ -3678,6 +4865,10 @@ int hovacui(int argn, char *argv[], struct cairodevice *cairodevice) {
 	output.screenaspect = -1;
 	output.rectangle = NULL;
 	output.cachefile = TRUE;
+	output.cachedpages = 8;
+	output.prefetch = 1;
+	output.renderthread = TRUE;
+	output.rendering = FALSE;
 
 	firstwindow = WINDOW_TUTORIAL;
 	outdev = NULL;
@@ -3731,8 +4922,8 @@ int hovacui(int argn, char *argv[], struct cairodevice *cairodevice) {
 			output.minwidth = d;
 		if (sscanf(configline, "order %s", s) == 1)
 			output.order = optindex(s[0], "qtc");
-		if (sscanf(configline, "distance %lg", &d) == 1)
-			output.distance = d;
+		if (sscanf(configline, "distance %s", s) == 1)
+			output.distance = textdistancearg(s, output.distance);
 		if (sscanf(configline, "aspect %s", s) == 1)
 			output.screenaspect = fraction(s);
 		if (sscanf(configline, "scroll %s", s) == 1)
@@ -3766,6 +4957,10 @@ int hovacui(int argn, char *argv[], struct cairodevice *cairodevice) {
 		}
 		if (sscanf(configline, "log %d", &i) == 1)
 			cairoui.log = i;
+		if (sscanf(configline, "cachedpages %d", &i) == 1)
+			output.cachedpages = i;
+		if (sscanf(configline, "prefetch %d", &i) == 1)
+			output.prefetch = i;
 
 		if (sscanf(configline, "%s", s) == 1) {
 			if (! strcmp(s, "noui"))
@@ -3805,6 +5000,8 @@ int hovacui(int argn, char *argv[], struct cairodevice *cairodevice) {
 				output.current = CURRENT_NONE;
 			if (! strcmp(s, "nocachefile"))
 				output.cachefile = FALSE;
+			if (! strcmp(s, "norenderthread"))
+				output.renderthread = FALSE;
 			if (! strcmp(s, "log script"))
 				cairoui.log = -1;
 		}
@@ -3846,8 +5043,9 @@ int hovacui(int argn, char *argv[], struct cairodevice *cairodevice) {
 			}
 			break;
 		case 't':
-			output.distance = atof(optarg);
-			if (output.distance < 0) {
+			output.distance =
+				textdistancearg(optarg, output.distance);
+			if (output.distance < 0 && output.distance != -1) {
 				printf("error: negative text distance\n");
 				exit(EXIT_FAILURE);
 			}
@@ -3923,7 +5121,7 @@ int hovacui(int argn, char *argv[], struct cairodevice *cairodevice) {
 
 				/* open input file */
 
-	callback.position = openpdf(filename);
+	callback.position = openpdf(filename, output.cachedpages);
 	if (callback.position == NULL)
 		exit(EXIT_FAILURE);
 	initposition(callback.position);
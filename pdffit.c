@@ -228,6 +228,7 @@ int main(int argc, char *argv[]) {
 		printf("error opening pdf file\n");
 		exit(EXIT_FAILURE);
 	}
+	pagecache_document(doc);
 
 	npages = poppler_document_get_n_pages(doc);
 	if (npages < 1) {
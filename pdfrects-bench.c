@@ -0,0 +1,351 @@
+/*
+ * benchmark of the rectangle functions of pdfrects.c
+ *
+ * arguments:
+ *	-w workload	only this workload: grid, columns, table, nested
+ *	-o operation	only this operation: subtract1, join, consecutive,
+ *			quicksort, twosort, charsort, contain
+ *	-n size		only this number of rectangles
+ *	-t seconds	minimal time spent on each measure (default 0.2)
+ *
+ * the workloads are synthetic lists of rectangles, generated from a fixed seed
+ * so that they are the same at each run:
+ *
+ * grid		lines of random-width glyphs separated by random spaces
+ * columns	the same, in two columns
+ * table	short words in the cells of a table of six columns
+ * nested	frames each inside the other, each made of four thin rectangles
+ *
+ * the output is a yaml list, one element for each workload, size and
+ * operation; ns/op is the average time of a call, or of a single lookup for
+ * contain; the allocation statistics are those of a single call
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+
+#include <poppler.h>
+
+#include "pdfrects.h"
+
+/*
+ * random numbers, the same on every platform
+ */
+guint64 benchseed;
+
+double benchrandom(double min, double max) {
+	benchseed ^= benchseed << 13;
+	benchseed ^= benchseed >> 7;
+	benchseed ^= benchseed << 17;
+	return min + (max - min) * (benchseed % 1000000) / 1000000.0;
+}
+
+/*
+ * append a glyph
+ */
+void benchglyph(RectangleList *rl, double x, double y, double w, double h) {
+	PopplerRectangle r;
+	r.x1 = x;
+	r.y1 = y;
+	r.x2 = x + w;
+	r.y2 = y + h;
+	rectanglelist_append(rl, &r);
+}
+
+/*
+ * lines of text in a number of columns of a given width
+ */
+RectangleList *benchtext(int n, int columns, double width) {
+	RectangleList *rl;
+	double x, y, w, left;
+	int lines, perline, c;
+
+	perline = width / 6.5;
+	lines = (n + perline * columns - 1) / (perline * columns);
+	rl = rectanglelist_new(n);
+	for (c = 0; c < columns && rl->num < n; c++) {
+		left = 20 + c * (width + 40);
+		for (y = 20;
+		     (c == columns - 1 || y < 20 + lines * 12) && rl->num < n;
+		     y += 12)
+			for (x = left; rl->num < n; x += w) {
+				w = benchrandom(4, 8);
+				if (x + w > left + width)
+					break;
+				benchglyph(rl, x, y, w, benchrandom(8, 10));
+				w += benchrandom(0, 1) < 0.2 ?
+					benchrandom(3, 5) : benchrandom(0, 1);
+			}
+	}
+	return rl;
+}
+
+/*
+ * short words in the cells of a table
+ */
+RectangleList *benchtable(int n) {
+	RectangleList *rl;
+	double x, y, w;
+	int c, g, glyphs;
+
+	rl = rectanglelist_new(n);
+	for (y = 20; rl->num < n; y += 16)
+		for (c = 0; c < 6 && rl->num < n; c++) {
+			x = 20 + c * 90;
+			glyphs = benchrandom(3, 7);
+			for (g = 0; g < glyphs && rl->num < n; g++) {
+				w = benchrandom(4, 8);
+				benchglyph(rl, x, y, w, benchrandom(8, 10));
+				x += w + benchrandom(0, 1);
+			}
+		}
+	return rl;
+}
+
+/*
+ * frames each inside the other
+ */
+RectangleList *benchnested(int n) {
+	RectangleList *rl;
+	double s, d;
+	int levels, l;
+
+	levels = (n + 3) / 4;
+	s = 4 * levels + 100;
+	rl = rectanglelist_new(n);
+	for (l = 0; l < levels; l++) {
+		d = 20 + 2 * l;
+		benchglyph(rl, d, d, s - 2 * d, 1);
+		benchglyph(rl, d, s - d - 1, s - 2 * d, 1);
+		benchglyph(rl, d, d + 1, 1, s - 2 * d - 2);
+		benchglyph(rl, s - d - 1, d + 1, 1, s - 2 * d - 2);
+	}
+	rl->num = n;
+	return rl;
+}
+
+/*
+ * generate a workload
+ */
+char *workloads[] = {"grid", "columns", "table", "nested", NULL};
+
+RectangleList *benchworkload(int workload, int n) {
+	benchseed = 88172645463325252ULL;
+	switch (workload) {
+	case 0:
+		return benchtext(n, 1, 560);
+	case 1:
+		return benchtext(n, 2, 260);
+	case 2:
+		return benchtable(n);
+	case 3:
+		return benchnested(n);
+	}
+	return NULL;
+}
+
+/*
+ * shuffle a list
+ */
+void benchshuffle(RectangleList *rl) {
+	int i, j;
+	for (i = rl->num - 1; i > 0; i--) {
+		j = benchrandom(0, i + 1);
+		rectangle_swap(&rl->rect[i], &rl->rect[j]);
+	}
+}
+
+/*
+ * current time in nanoseconds
+ */
+double benchnow() {
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec * 1e9 + t.tv_nsec;
+}
+
+/*
+ * run an operation once on a workload, return the number of calls or lookups
+ * and the time they take
+ */
+char *operations[] = {"subtract1", "join", "consecutive",
+	"quicksort", "twosort", "charsort", "contain", NULL};
+
+int benchrun(int operation, RectangleList *workload, double *ns) {
+	RectangleList *rl, *res;
+	RectangleBound b;
+	PopplerRectangle page, *all, point;
+	double start;
+	int i, ops;
+
+	rl = rectanglelist_copy(workload);
+	res = NULL;
+	ops = 1;
+
+	switch (operation) {
+	case 0:
+		all = rectanglelist_joinall(rl);
+		page = *all;
+		poppler_rectangle_free(all);
+		rectangle_expand(&page, 10, 10);
+		b.both = 10;
+		b.each = 100;
+		start = benchnow();
+		res = rectanglelist_subtract1(&page, rl, NULL, &b);
+		*ns = benchnow() - start;
+		break;
+	case 1:
+		for (i = 0; i < rl->num; i++)
+			rectangle_expand(&rl->rect[i], 2, 2);
+		start = benchnow();
+		rectanglelist_join(rl);
+		*ns = benchnow() - start;
+		break;
+	case 2:
+		start = benchnow();
+		rectanglelist_consecutive(rl);
+		*ns = benchnow() - start;
+		break;
+	case 3:
+		benchshuffle(rl);
+		start = benchnow();
+		rectanglelist_quicksort(rl, NULL);
+		*ns = benchnow() - start;
+		break;
+	case 4:
+		benchshuffle(rl);
+		start = benchnow();
+		rectanglelist_twosort(rl, NULL);
+		*ns = benchnow() - start;
+		break;
+	case 5:
+		rectanglelist_consecutive(rl);
+		benchshuffle(rl);
+		start = benchnow();
+		rectanglelist_charsort_layout(rl, workload->rect,
+			workload->num);
+		*ns = benchnow() - start;
+		break;
+	case 6:
+		ops = workload->num;
+		start = benchnow();
+		for (i = 0; i < ops; i++) {
+			point.x1 = workload->rect[i].x1 + 1;
+			point.y1 = workload->rect[i].y1 + 1;
+			point.x2 = point.x1;
+			point.y2 = point.y1;
+			rectanglelist_contain(rl, &point);
+		}
+		*ns = benchnow() - start;
+		break;
+	}
+
+	rectanglelist_free(res);
+	rectanglelist_free(rl);
+	return ops;
+}
+
+/*
+ * measure an operation on a workload
+ */
+void bench(int workload, int n, int operation, double seconds) {
+	RectangleList *rl;
+	RectangleStats stats;
+	long base;
+	double ns, total;
+	int runs, ops;
+
+	rl = benchworkload(workload, n);
+
+	rectanglestats_reset();
+	base = rectanglestats.bytes;
+	benchrun(operation, rl, &ns);
+	stats = rectanglestats;
+
+	total = 0;
+	ops = 0;
+	for (runs = 0; runs < 3 || total < seconds * 1e9; runs++) {
+		ops += benchrun(operation, rl, &ns);
+		total += ns;
+	}
+
+	printf("- workload: %s\n", workloads[workload]);
+	printf("  size: %d\n", rl->num);
+	printf("  operation: %s\n", operations[operation]);
+	printf("  runs: %d\n", runs);
+	printf("  ns/op: %.0f\n", total / ops);
+	printf("  lists: %ld\n", stats.lists);
+	printf("  arrays: %ld\n", stats.arrays);
+	printf("  indexes: %ld\n", stats.indexes);
+	printf("  peak: %ld\n", stats.peak - base);
+
+	rectanglelist_free(rl);
+}
+
+/*
+ * main
+ */
+int main(int argc, char *argv[]) {
+	int opt;
+	gboolean usage = FALSE;
+	char *workload = NULL, *operation = NULL;
+	int size = -1;
+	double seconds = 0.2;
+	int sizes[] = {100, 1000, 10000, -1};
+	int w, s, o;
+
+	while (-1 != (opt = getopt(argc, argv, "w:o:n:t:h")))
+		switch (opt) {
+		case 'w':
+			workload = optarg;
+			break;
+		case 'o':
+			operation = optarg;
+			break;
+		case 'n':
+			size = atoi(optarg);
+			break;
+		case 't':
+			seconds = atof(optarg);
+			break;
+		case 'h':
+			usage = TRUE;
+			break;
+		default:
+			usage = TRUE;
+		}
+
+	if (usage || argc - optind > 0) {
+		printf("usage:\n");
+		printf("\tpdfrects-bench [-w workload] [-o operation] ");
+		printf("[-n size] [-t seconds]\n");
+		printf("\t\t-w workload\tgrid, columns, table or nested\n");
+		printf("\t\t-o operation\tsubtract1, join, consecutive, ");
+		printf("quicksort,\n\t\t\t\ttwosort, charsort or contain\n");
+		printf("\t\t-n size\t\tnumber of rectangles\n");
+		printf("\t\t-t seconds\tminimal time of each measure\n");
+		exit(EXIT_FAILURE);
+	}
+
+	for (w = 0; workloads[w] != NULL; w++) {
+		if (workload != NULL && strcmp(workload, workloads[w]))
+			continue;
+		for (s = 0; sizes[s] != -1; s++) {
+			if (size != -1 && s > 0)
+				break;
+			for (o = 0; operations[o] != NULL; o++) {
+				if (operation != NULL &&
+				    strcmp(operation, operations[o]))
+					continue;
+				bench(w, size != -1 ? size : sizes[s],
+					o, seconds);
+				fflush(stdout);
+			}
+		}
+	}
+
+	return EXIT_SUCCESS;
+}
@@ -8,6 +8,10 @@
  *	-e direction	horizontal or vertical extents
  *	-d distance	minimal size of a white space
  *	-r level	the debugtextrectangles variables (-1 - 5, see below)
+ *	-u method	rectangle subtraction algorithm (0-1)
+ *	-g method	textarea algorithm (0-2)
+ *	-M		print allocation statistics for each page
+ *	-T format	report the time of each stage (text or json)
  *	-n		draw also the number of each rectangle
  *	-i		draw the numbers inside the box, not by its side
  *	-s		sort rectangles
@@ -46,6 +50,7 @@ int main(int argc, char *argv[]) {
 	gboolean painted = FALSE;
 	gboolean tabular = FALSE;
 	gboolean add = FALSE;
+	gboolean stats = FALSE;
 	int sort = -1;
 	int first = -1, last = -1;
 	char *infile, *outfile;
@@ -72,7 +77,9 @@ int main(int argc, char *argv[]) {
 
 				/* arguments */
 
-	while ((opt = getopt(argc, argv, "f:l:nipts:bme:d:r:ah")) != -1)
+	if (! pagetiming_enable(NULL))
+		fprintf(stderr, "PDFTIMING is not text or json, ignored\n");
+	while ((opt = getopt(argc, argv, "f:l:nipts:bme:d:r:u:g:aMT:h")) != -1)
 		switch(opt) {
 		case 'f':
 			first = atoi(optarg);
@@ -120,9 +127,24 @@ int main(int argc, char *argv[]) {
 		case 'r':
 			debugtextrectangles = atoi(optarg);
 			break;
+		case 'u':
+			subtractmethod = atoi(optarg);
+			break;
+		case 'g':
+			textareamethod = atoi(optarg);
+			break;
 		case 'a':
 			add = TRUE;
 			break;
+		case 'M':
+			stats = TRUE;
+			break;
+		case 'T':
+			if (! pagetiming_enable(optarg)) {
+				printf("unsupported report: %s\n", optarg);
+				exit(EXIT_FAILURE);
+			}
+			break;
 		case 'h':
 			usage = TRUE;
 			break;
@@ -136,8 +158,9 @@ int main(int argc, char *argv[]) {
 		printf("usage:\n");
 		printf("\tpdfrects [-f page] [-l page] ");
 		printf("[-b|-m] [-e direction] [-d distance]\n");
-		printf("\t         [-p|-t] [-n [-s n]] [-a] [-r level] [-h] ");
-		printf("file.pdf\n");
+		printf("\t         [-p|-t] [-n [-s n]] [-a] [-r level] ");
+		printf("[-u method] [-g method] [-M] [-T format]\n");
+		printf("\t         [-h] file.pdf\n");
 		printf("\t\t-f page\t\tfirst page\n");
 		printf("\t\t-l page\t\tlast page\n");
 		printf("\t\t-b\t\tbounding box instead of textarea\n");
@@ -150,6 +173,10 @@ int main(int argc, char *argv[]) {
 		printf("\t\t-s n\t\tsort boxes by method n\n");
 		printf("\t\t-a\t\tadd a test box\n");
 		printf("\t\t-r level\tdebug textarea algorithm\n");
+		printf("\t\t-u method\tsubtraction algorithm\n");
+		printf("\t\t-g method\ttextarea algorithm\n");
+		printf("\t\t-M\t\tprint allocation statistics\n");
+		printf("\t\t-T format\treport time of stages (text, json)\n");
 		printf("\t\t-h\t\tthis help\n");
 		exit(EXIT_FAILURE);
 	}
@@ -165,6 +192,7 @@ int main(int argc, char *argv[]) {
 		printf("error opening pdf file\n");
 		exit(EXIT_FAILURE);
 	}
+	pagecache_document(doc);
 
 				/* pages */
 
@@ -198,6 +226,9 @@ int main(int argc, char *argv[]) {
 
 	for (n = first; n <= last; n++) {
 		printf("  - page: %d\n", n);
+		if (stats)
+			rectanglestats_reset();
+		pagetiming_page(n);
 		page = poppler_document_get_page(doc, n);
 		poppler_page_get_size(page, &width, &height);
 		cairo_pdf_surface_set_size(surface, width, height);
@@ -238,6 +269,12 @@ int main(int argc, char *argv[]) {
 			fflush(stdout);
 		}
 
+		if (stats) {
+			printf("    allocations:\n");
+			rectanglestats_printyaml(stdout, "      ");
+		}
+		pagetiming_endpage();
+
 		if (add) {
 			singlechars = rectanglelist_characters(page);
 			wholepage.x2 = width;
@@ -266,6 +303,7 @@ int main(int argc, char *argv[]) {
 	}
 
 	cairo_surface_destroy(surface);
+	pagetiming_report(stderr);
 
 	return EXIT_SUCCESS;
 }
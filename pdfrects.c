@@ -41,6 +41,31 @@
  *	union of the largest boxes in the whole document (NULL if no text)
  */
 
+/*
+ * the text of a page
+ *
+ * poppler extracts the text of a page anew for each of
+ * poppler_page_get_text(), poppler_page_get_text_layout() and
+ * poppler_page_get_text_attributes(); a PageText fetches each of them the
+ * first time it is requested and then lends it to whoever needs it
+ *
+ * the functions that take a PopplerPage and use its text are shorthands for
+ * the *_pagetext() ones on a PageText created and freed on the spot; a
+ * program that computes more than one of them on the same page creates a
+ * single PageText for all of them
+ *
+ * the PageText holds a reference to the page until pagetext_release() or
+ * pagetext_free(); after pagetext_release(), only what was already fetched is
+ * available, but the PageText no longer depends on the document and can be
+ * freed by a thread other than the one owning it; when the page cache is
+ * enabled, pagetext_free() stores in the cache what was fetched, if it
+ * includes the text and the layout, without requesting anything more
+ *
+ * the page cache is enabled by pagecache_document() if a directory is given;
+ * it is per thread, since each thread of a program may work on its own copy
+ * of a document
+ */
+
 /*
  * the algorithm for finding blocks of text:
  *
@@ -76,6 +101,113 @@
  *     changes during a subtraction
  */
 
+/*
+ * the raster textarea
+ *
+ * when textareamethod is 1, rectanglelist_textarea_distance() uses a faster
+ * and less precise algorithm:
+ *
+ * 1. the page is divided in a grid of square cells, about a quarter of the
+ *    distance wide; the cells touched by some character are marked
+ *
+ * 2. a morphological close fills the unmarked spaces of the grid smaller than
+ *    the distance: first each marked cell extends to the cells around it up to
+ *    half the distance (dilation), then each cell remains marked only if all
+ *    cells around it up to half the distance are (erosion)
+ *
+ * 3. each connected set of marked cells is a block; its rectangle is the
+ *    smallest containing all characters in it
+ *
+ * 4. touching or overlapping rectangles are joined
+ *
+ * all steps are linear in the number of characters plus the number of cells;
+ * the latter is at most RASTERMAX for each side; the result differs from that
+ * of the subtraction algorithm because white areas are not required to be
+ * long, and because the cells are larger than a point
+ */
+
+/*
+ * the textarea hierarchy
+ *
+ * when textareamethod is 2, the blocks are the groups of consecutive
+ * characters joined when closer than the distance, where the distance between
+ * two rectangles is the maximum of their horizontal and vertical distances;
+ * this is about the same criterion of the raster algorithm
+ *
+ * the groups for all distances up to a maximum are computed at once:
+ *
+ * RectangleHierarchy *rectanglehierarchy_new(PopplerPage *page,
+ *		gdouble maxdistance);
+ *	the pairs of groups of consecutive characters closer than maxdistance
+ *	are sorted by distance; going through them in this order, each pair in
+ *	different sets joins them; this is the order the groups would be
+ *	joined when increasing the distance from zero to maxdistance, and is
+ *	stored in the hierarchy
+ *
+ * RectangleList *rectanglehierarchy_cut(RectangleHierarchy *h,
+ *		gdouble distance);
+ *	the textarea for a distance: the joins of the hierarchy at smaller
+ *	distances are redone, which takes linear time in the number of groups
+ *	of consecutive characters; the page is not accessed
+ *
+ * a program can build the hierarchy once for a page and try several distances,
+ * like hovacui when changing the distance interactively; a distance larger than
+ * maxdistance gives the same result as maxdistance
+ */
+
+/*
+ * rectangle subtraction
+ *
+ * steps 3. and 4. subtract a list of rectangles from a list of rectangles;
+ * the result is the list of the maximal rectangles that do not overlap any
+ * of the subtracted rectangles; two algorithms are implemented, selected by
+ * the subtractmethod variable:
+ *
+ * 0. incremental: each subtracted rectangle is subtracted from all rectangles
+ *    in the list; this requires creating a new list for each, and checking
+ *    each new rectangle for containment against all others in the list
+ *
+ * 1. sweep line: the subtracted rectangles are sorted by their y1 and
+ *    processed from top to bottom; a rectangle in the list that ends above
+ *    the current subtracted rectangle cannot be changed by it or by the
+ *    following ones, since they all begin below it; it is moved from the
+ *    active list to the final one; only the active rectangles are checked
+ *    for overlap and containment; the active list is reused rather than
+ *    allocated anew for each subtracted rectangle
+ *
+ * the cost of the first is quadratic in the number of rectangles in the list
+ * for each subtracted rectangle; the second is O(n log n) for sorting plus
+ * O(a) for each subtracted rectangle, where a is the number of rectangles
+ * crossing the horizontal line at its top, which on pages of text is usually
+ * a small fraction of the total
+ *
+ * the two algorithms produce the same rectangles, but not necessarily in the
+ * same order
+ */
+
+/*
+ * the spatial index
+ *
+ * rectanglelist_contain(), rectanglelist_touch() and rectanglelist_overlap()
+ * return the first rectangle of a list in a relation with a given rectangle;
+ * on short lists they just scan the list; on lists of INDEXMIN rectangles or
+ * more, they first build a grid of cells over the area of the list, each cell
+ * storing the rectangles that touch it; only the rectangles in the cells
+ * touched by the given rectangle are then checked
+ *
+ * the grid is stored in the list and reused by the following queries; the
+ * functions that change the list drop it; code that changes the rectangles of
+ * a list directly has to call rectanglelist_unindex()
+ *
+ * along with the grid, the index stores the coordinates of the rectangles in
+ * four separate arrays, one for x1, one for y1 and so on; the short lists are
+ * scanned on them in blocks of ARRAYSBLOCK rectangles: each relation is a
+ * sequence of comparisons without branches and without function calls, which
+ * the compiler turns into vector instructions testing several rectangles at
+ * time; this is what happens when locating each character of a page in the
+ * textarea, which usually comprises less than INDEXMIN blocks
+ */
+
 /*
  * rectangle sorting
  *
@@ -96,11 +228,16 @@
  *
  * rectanglelist_quicksort() skips step b. for the sake of code simplicity
  *
- * rectanglelist_twosort() implements the ordering in two steps: first, a
- * variant of insertionsort that keeps into account the lack of transitive
- * closure sorts the elements that overlap horizontally based on their y1;
- * second, a variant of bubblesort sorts the elements according to their x1
- * while not swapping elements that overlap horizontally
+ * rectanglelist_twosort() implements the ordering in two steps: first, the
+ * pairs of rectangles that overlap horizontally are ordered by their y1, which
+ * makes a directed acyclic graph; second, a topological sort of the graph
+ * that chooses the rectangle of minimal x1 whenever more are possible closes
+ * the order transitively and orders the incomparable rectangles by x1
+ *
+ * rectanglelist_charsort() locates each character of the page in the blocks by
+ * the index of the list rather than scanning the list every time;
+ * rectanglelist_charsort_layout() does the same on a text layout already
+ * obtained from the page
  */
 
 /*
@@ -117,6 +254,12 @@
  *	in all cases (see below); also, for large document pages are sampled at
  *	random, so the result may change every time
  *
+ * RectangleList *rectanglevector_frequent_uri(PopplerDocument *doc,
+ *		char *uri, gdouble height, gdouble distance);
+ *	the same; with a memory ceiling, the pages are sampled on a copy of
+ *	the document opened from uri and reopened when memory is near the
+ *	ceiling, so that sampling a long document does not grow doc
+ *
  * PopplerRectangle *rectanglevector_main(PopplerDocument *doc,
  *		RectangleList *recur, gdouble height, gdouble distance);
  *	the largest rectangle in the page once the rectangles in recur have
@@ -162,6 +305,17 @@
 #include <stdio.h>
 #include <string.h>
 #include <libgen.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <utime.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <time.h>
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
 
 #include <poppler.h>
 #include <cairo.h>
@@ -184,6 +338,16 @@ int debugtextrectangles = 0;
  */
 int debugfrequent = 0x02 | 0x04;
 
+/*
+ * algorithm for subtracting rectangle lists: 0 = incremental, 1 = sweep line
+ */
+int subtractmethod = 1;
+
+/*
+ * algorithm for the textarea: 0 = subtraction, 1 = raster, 2 = hierarchy
+ */
+int textareamethod = 0;
+
 /*
  * print a rectangle
  */
@@ -296,6 +460,13 @@ gboolean rectangle_contain(PopplerRectangle *a, PopplerRectangle *b) {
 	return rectangle_hcontain(a, b) && rectangle_vcontain(a, b);
 }
 
+/*
+ * check whether the first rectangle is contained in the second
+ */
+gboolean rectangle_contained(PopplerRectangle *a, PopplerRectangle *b) {
+	return rectangle_contain(b, a);
+}
+
 /*
  * check if rectangles overlap
  */
@@ -439,6 +610,400 @@ void rectangle_page(PopplerPage *page, PopplerRectangle *rect) {
 	poppler_page_get_size(page, &rect->x2, &rect->y2);
 }
 
+/*
+ * allocation statistics of rectangle lists
+ */
+__thread RectangleStats rectanglestats = {0, 0, 0, 0, 0};
+
+/*
+ * account for the array of rectangles of a list changing size
+ */
+void rectanglestats_resize(gint oldmax, gint newmax) {
+	rectanglestats.arrays++;
+	rectanglestats.bytes +=
+		((long) newmax - oldmax) * (long) sizeof(PopplerRectangle);
+	if (rectanglestats.peak < rectanglestats.bytes)
+		rectanglestats.peak = rectanglestats.bytes;
+}
+
+/*
+ * reset the allocation statistics, but not the bytes currently allocated
+ */
+void rectanglestats_reset() {
+	rectanglestats.lists = 0;
+	rectanglestats.arrays = 0;
+	rectanglestats.indexes = 0;
+	rectanglestats.peak = rectanglestats.bytes;
+}
+
+/*
+ * print the allocation statistics
+ */
+void rectanglestats_printyaml(FILE *fd, char *indent) {
+	fprintf(fd, "%slists: %ld\n", indent, rectanglestats.lists);
+	fprintf(fd, "%sarrays: %ld\n", indent, rectanglestats.arrays);
+	fprintf(fd, "%sindexes: %ld\n", indent, rectanglestats.indexes);
+	fprintf(fd, "%sbytes: %ld\n", indent, rectanglestats.bytes);
+	fprintf(fd, "%speak: %ld\n", indent, rectanglestats.peak);
+}
+
+/*
+ * timing of the stages of the analysis of the pages
+ *
+ * each thread accumulates the time and the number of resulting rectangles of
+ * each stage in the record of its current page; the record is collected when
+ * the page ends; a page may have more records, for example one for its
+ * analysis and one for its output, which are summed in the report
+ */
+int pagetiming = 0;
+
+char *pagetiming_stages[] = {
+	"extract", "consecutive", "white", "black", "join",
+	"raster", "hierarchy", "rows", "sort", "emit", NULL
+};
+
+struct pagetime {
+	int npage;
+	gint64 ns[STAGES];
+	long count[STAGES];
+};
+
+__thread struct pagetime pagetiming_current = {-1, {0}, {0}};
+__thread gboolean pagetiming_used = FALSE;
+
+GMutex pagetiming_mutex;
+struct pagetime *pagetiming_pages = NULL;
+int pagetiming_num = 0, pagetiming_max = 0;
+
+/*
+ * enable timing, with report as "text" or "json"; NULL = from $PDFTIMING
+ */
+gboolean pagetiming_enable(char *format) {
+	if (format == NULL) {
+		format = getenv("PDFTIMING");
+		if (format == NULL || format[0] == '\0')
+			return TRUE;
+	}
+	if (! strcmp(format, "text"))
+		pagetiming = 1;
+	else if (! strcmp(format, "json"))
+		pagetiming = 2;
+	else
+		return FALSE;
+	return TRUE;
+}
+
+/*
+ * current time, if timing
+ */
+gint64 pagetiming_now() {
+	struct timespec t;
+
+	if (! pagetiming)
+		return 0;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec * (gint64) 1000000000 + t.tv_nsec;
+}
+
+/*
+ * end of a stage started at time start, resulting in count rectangles
+ */
+void pagetiming_stage(int stage, gint64 start, long count) {
+	if (! pagetiming)
+		return;
+	pagetiming_current.ns[stage] += pagetiming_now() - start;
+	pagetiming_current.count[stage] += count;
+	pagetiming_used = TRUE;
+}
+
+/*
+ * end the current page of the thread, start a new one
+ */
+void pagetiming_endpage() {
+	if (! pagetiming)
+		return;
+	if (pagetiming_used) {
+		g_mutex_lock(&pagetiming_mutex);
+		if (pagetiming_num >= pagetiming_max) {
+			pagetiming_max = pagetiming_max * 2 + 64;
+			pagetiming_pages = realloc(pagetiming_pages,
+				pagetiming_max * sizeof(struct pagetime));
+		}
+		pagetiming_pages[pagetiming_num++] = pagetiming_current;
+		g_mutex_unlock(&pagetiming_mutex);
+	}
+	memset(&pagetiming_current, 0, sizeof(struct pagetime));
+	pagetiming_current.npage = -1;
+	pagetiming_used = FALSE;
+}
+
+void pagetiming_page(int npage) {
+	if (! pagetiming)
+		return;
+	pagetiming_endpage();
+	pagetiming_current.npage = npage;
+}
+
+/*
+ * report of the timing
+ */
+int pagetiming_comparepage(const void *a, const void *b) {
+	return ((struct pagetime *) a)->npage - ((struct pagetime *) b)->npage;
+}
+
+int pagetiming_comparens(const void *a, const void *b) {
+	gint64 x = *(gint64 *) a, y = *(gint64 *) b;
+	return x < y ? -1 : x > y ? 1 : 0;
+}
+
+gint64 pagetiming_pagetotal(struct pagetime *p) {
+	gint64 total = 0;
+	int s;
+
+	for (s = 0; s < STAGES; s++)
+		total += p->ns[s];
+	return total;
+}
+
+int pagetiming_compareworst(const void *a, const void *b) {
+	gint64 x = pagetiming_pagetotal((struct pagetime *) a);
+	gint64 y = pagetiming_pagetotal((struct pagetime *) b);
+	return x > y ? -1 : x < y ? 1 : 0;
+}
+
+/* percentile p of n sorted values */
+gint64 pagetiming_percentile(gint64 *v, int n, int p) {
+	int i;
+
+	if (n == 0)
+		return 0;
+	i = (n * p + 99) / 100 - 1;
+	return v[i < 0 ? 0 : i];
+}
+
+#define MS(ns) ((ns) / 1e6)
+#define WORST 20
+
+void pagetiming_report(FILE *fd) {
+	struct pagetime *pages, total;
+	int npages, i, s;
+	gint64 *v, all, ns, p50, p90, p99, max;
+	long rects;
+	char *name;
+
+	if (! pagetiming)
+		return;
+	pagetiming_endpage();
+
+				/* sum records of the same page */
+
+	qsort(pagetiming_pages, pagetiming_num, sizeof(struct pagetime),
+		pagetiming_comparepage);
+	memset(&total, 0, sizeof(struct pagetime));
+	pages = malloc((pagetiming_num + 1) * sizeof(struct pagetime));
+	npages = 0;
+	for (i = 0; i < pagetiming_num; i++) {
+		for (s = 0; s < STAGES; s++) {
+			total.ns[s] += pagetiming_pages[i].ns[s];
+			total.count[s] += pagetiming_pages[i].count[s];
+		}
+		if (pagetiming_pages[i].npage < 0)
+			continue;
+		if (npages > 0 &&
+		    pages[npages - 1].npage == pagetiming_pages[i].npage)
+			for (s = 0; s < STAGES; s++) {
+				pages[npages - 1].ns[s] +=
+					pagetiming_pages[i].ns[s];
+				pages[npages - 1].count[s] +=
+					pagetiming_pages[i].count[s];
+			}
+		else
+			pages[npages++] = pagetiming_pages[i];
+	}
+	all = pagetiming_pagetotal(&total);
+
+				/* stages and whole pages */
+
+	v = malloc((npages + 1) * sizeof(gint64));
+	if (pagetiming == 1) {
+		fprintf(fd, "timing: %d pages, %.3f ms\n", npages, MS(all));
+		fprintf(fd, "%-12s %10s %6s %10s %9s %9s %9s %9s\n",
+			"stage", "total ms", "%", "rects",
+			"p50 ms", "p90 ms", "p99 ms", "max ms");
+	}
+	else
+		fprintf(fd, "{\"pages\": %d, \"total_ms\": %.3f, "
+			"\"stages\": [", npages, MS(all));
+	for (s = 0; s <= STAGES; s++) {
+		name = s < STAGES ? pagetiming_stages[s] : "page";
+		ns = s < STAGES ? total.ns[s] : all;
+		rects = s < STAGES ? total.count[s] : 0;
+		for (i = 0; i < npages; i++)
+			v[i] = s < STAGES ?
+				pages[i].ns[s] : pagetiming_pagetotal(&pages[i]);
+		qsort(v, npages, sizeof(gint64), pagetiming_comparens);
+		p50 = pagetiming_percentile(v, npages, 50);
+		p90 = pagetiming_percentile(v, npages, 90);
+		p99 = pagetiming_percentile(v, npages, 99);
+		max = npages == 0 ? 0 : v[npages - 1];
+		if (pagetiming == 1 && ns == 0 && rects == 0)
+			continue;
+		if (pagetiming == 1)
+			fprintf(fd, "%-12s %10.3f %6.1f %10ld "
+				"%9.3f %9.3f %9.3f %9.3f\n",
+				name, MS(ns), all == 0 ? 0.0 : 100.0 * ns / all,
+				rects, MS(p50), MS(p90), MS(p99), MS(max));
+		else
+			fprintf(fd, "%s\n  {\"stage\": \"%s\", "
+				"\"total_ms\": %.3f, \"rects\": %ld, "
+				"\"p50_ms\": %.3f, \"p90_ms\": %.3f, "
+				"\"p99_ms\": %.3f, \"max_ms\": %.3f}",
+				s == 0 ? "" : ",", name, MS(ns), rects,
+				MS(p50), MS(p90), MS(p99), MS(max));
+	}
+
+				/* worst pages */
+
+	qsort(pages, npages, sizeof(struct pagetime),
+		pagetiming_compareworst);
+	if (pagetiming == 1) {
+		fprintf(fd, "worst pages (ms, rectangles):\n");
+		fprintf(fd, "%6s %10s", "page", "total");
+		for (s = 0; s < STAGES; s++)
+			if (total.ns[s] != 0 || total.count[s] != 0)
+				fprintf(fd, " %18s", pagetiming_stages[s]);
+		fprintf(fd, "\n");
+	}
+	else
+		fprintf(fd, "],\n \"worst\": [");
+	for (i = 0; i < npages && i < WORST; i++) {
+		if (pagetiming == 1)
+			fprintf(fd, "%6d %10.3f", pages[i].npage + 1,
+				MS(pagetiming_pagetotal(&pages[i])));
+		else
+			fprintf(fd, "%s\n  {\"page\": %d, \"total_ms\": %.3f",
+				i == 0 ? "" : ",", pages[i].npage + 1,
+				MS(pagetiming_pagetotal(&pages[i])));
+		for (s = 0; s < STAGES; s++)
+			if (pagetiming == 1) {
+				if (total.ns[s] != 0 || total.count[s] != 0)
+					fprintf(fd, " %10.3f %7ld",
+						MS(pages[i].ns[s]),
+						pages[i].count[s]);
+			}
+			else if (pages[i].ns[s] != 0)
+				fprintf(fd, ", \"%s_ms\": %.3f, "
+					"\"%s_rects\": %ld",
+					pagetiming_stages[s],
+					MS(pages[i].ns[s]),
+					pagetiming_stages[s],
+					pages[i].count[s]);
+		fprintf(fd, pagetiming == 1 ? "\n" : "}");
+	}
+	if (pagetiming == 2)
+		fprintf(fd, "]}\n");
+
+	free(v);
+	free(pages);
+}
+
+/*
+ * memory ceiling for long conversions
+ *
+ * a document is reopened when the resident memory exceeds three quarters of
+ * the ceiling, which drops the pages, fonts and streams that poppler keeps
+ * until the document is closed; at least RECYCLEPAGES pages are processed
+ * with each document, so that a document is not reopened at every page if
+ * memory stays high for other reasons
+ */
+long memoryceiling = 0;
+
+#define RECYCLEPAGES 8
+
+/*
+ * set the ceiling in megabytes; NULL = from $PDFMEMORY
+ */
+gboolean memory_ceiling(char *megabytes) {
+	char *end;
+	long m;
+
+	if (megabytes == NULL) {
+		megabytes = getenv("PDFMEMORY");
+		if (megabytes == NULL || megabytes[0] == '\0')
+			return TRUE;
+	}
+	m = strtol(megabytes, &end, 10);
+	if (*end != '\0' || m <= 0)
+		return FALSE;
+	memoryceiling = m * 1024 * 1024;
+	return TRUE;
+}
+
+/*
+ * current and maximal resident memory, in bytes
+ */
+long memory_rss() {
+	FILE *fd;
+	long size, resident;
+
+	fd = fopen("/proc/self/statm", "r");
+	if (fd == NULL)
+		return 0;
+	if (fscanf(fd, "%ld %ld", &size, &resident) != 2)
+		resident = 0;
+	fclose(fd);
+	return resident * sysconf(_SC_PAGESIZE);
+}
+
+long memory_peak() {
+	struct rusage usage;
+
+	if (getrusage(RUSAGE_SELF, &usage) == -1)
+		return 0;
+	return usage.ru_maxrss * 1024L;
+}
+
+/*
+ * whether the resident memory is near the ceiling
+ */
+gboolean memory_near() {
+	return memoryceiling > 0 && memory_rss() > memoryceiling / 4 * 3;
+}
+
+/*
+ * count a page processed with a document and reopen it if memory is near the
+ * ceiling; return the document to use for the next pages
+ */
+PopplerDocument *memory_recycle(PopplerDocument *doc, char *uri,
+		int *pages) {
+	PopplerDocument *new;
+
+	(*pages)++;
+	if (uri == NULL || *pages < RECYCLEPAGES || ! memory_near())
+		return doc;
+
+	new = poppler_document_new_from_file(uri, NULL, NULL);
+	if (new == NULL)
+		return doc;
+	g_object_unref(doc);
+#ifdef __GLIBC__
+	malloc_trim(0);
+#endif
+	pagecache_document(new);
+	*pages = 0;
+	return new;
+}
+
+/*
+ * print the peak of resident memory, if a ceiling is set
+ */
+void memory_report(FILE *fd) {
+	if (memoryceiling == 0)
+		return;
+	fprintf(fd, "peak resident memory: %ld kB (ceiling %ld kB)\n",
+		memory_peak() / 1024, memoryceiling / 1024);
+}
+
 /*
  * allocate a rectangle list with maximum n rectangles and currently none
  */
@@ -449,6 +1014,29 @@ RectangleList *rectanglelist_new(int n) {
 	res->num = 0;
 	res->max = n;
 	res->rect = malloc(res->max * sizeof(PopplerRectangle));
+	res->index = NULL;
+
+	rectanglestats.lists++;
+	rectanglestats_resize(0, res->max);
+
+	return res;
+}
+
+/*
+ * a rectangle list made of an array of n rectangles allocated by glib, like
+ * that returned by poppler_page_get_text_layout()
+ */
+RectangleList *rectanglelist_array(PopplerRectangle *rect, gint n) {
+	RectangleList *res;
+
+	res = malloc(sizeof(RectangleList));
+	res->num = n;
+	res->max = n;
+	res->rect = rect;
+	res->index = NULL;
+
+	rectanglestats.lists++;
+	rectanglestats_resize(0, res->max);
 
 	return res;
 }
@@ -470,6 +1058,8 @@ RectangleList *rectanglelist_copy(RectangleList *src) {
  * thighten a rectangle list by deallocating the unused entries
  */
 void rectanglelist_tighten(RectangleList *r) {
+	rectanglelist_unindex(r);
+	rectanglestats_resize(r->max, r->num);
 	r->max = r->num;
 	r->rect = realloc(r->rect, r->max * sizeof(PopplerRectangle));
 }
@@ -480,6 +1070,8 @@ void rectanglelist_tighten(RectangleList *r) {
 void rectanglelist_free(RectangleList *rl) {
 	if (rl == NULL)
 		return;
+	rectanglelist_unindex(rl);
+	rectanglestats.bytes -= rl->max * (long) sizeof(PopplerRectangle);
 	free(rl->rect);
 	free(rl);
 }
@@ -503,21 +1095,39 @@ void rectanglelist_printyaml(FILE *fd, char *first, char *indent,
 		rectangle_printyaml(fd, first, indent, &rl->rect[r]);
 }
 
+/*
+ * empty a rectangle list, keeping its allocated space for reuse
+ */
+void rectanglelist_clear(RectangleList *rl) {
+	rectanglelist_unindex(rl);
+	rl->num = 0;
+}
+
 /*
  * remove a rectangle from a list
  */
 void rectanglelist_delete(RectangleList *rl, gint n) {
 	if (n >= rl->num)
 		return;
+	rectanglelist_unindex(rl);
 	rectangle_copy(rl->rect + n, rl->rect + --rl->num);
 }
 
 /*
  * append a rectangle to a list
+ *
+ * the list grows by MAXRECT rectangles at least, by doubling its size when
+ * already larger; this way, filling a long list takes a logarithmic number of
+ * reallocations rather than a linear one
  */
 void rectanglelist_append(RectangleList *rl, PopplerRectangle *rect) {
+	gint max;
+
+	rectanglelist_unindex(rl);
 	if (rl->num >= rl->max) {
-		rl->max += MAXRECT;
+		max = MAX(rl->max * 2, rl->max + MAXRECT);
+		rectanglestats_resize(rl->max, max);
+		rl->max = max;
 		rl->rect =
 			realloc(rl->rect, rl->max * sizeof(PopplerRectangle));
 	}
@@ -541,6 +1151,7 @@ gboolean rectanglelist_add(RectangleList *rl, PopplerRectangle *rect) {
 	gboolean placed;
 
 	placed = FALSE;
+	rectanglelist_unindex(rl);
 
 	for (r = 0; r < rl->num; r++) {
 		if (rectangle_contain(rl->rect + r, rect))
@@ -648,150 +1259,648 @@ double rectanglelist_averageheight(RectangleList *rl) {
 }
 
 /*
- * index of rectangle in a list containing another rectangle
+ * minimal number of rectangles for a list to be indexed
  */
-gint rectanglelist_contain(RectangleList *rl, PopplerRectangle *r) {
-	gint index;
-	for (index = 0; index < rl->num; index++)
-		if (rectangle_contain(&rl->rect[index], r))
-			return index;
-	return -1;
-}
+#define INDEXMIN 32
 
 /*
- * index of rectangle in a list touching another rectangle
+ * column and row of the index cell of a coordinate
  */
-gint rectanglelist_touch(RectangleList *rl, PopplerRectangle *r) {
-	gint index;
-	for (index = 0; index < rl->num; index++)
-		if (rectangle_touch(&rl->rect[index], r))
-			return index;
-	return -1;
+gint rectangleindex_col(RectangleIndex *ri, gdouble x) {
+	gint c;
+	c = (x - ri->box.x1) / ri->cellwidth;
+	return c < 0 ? 0 : c >= ri->cols ? ri->cols - 1 : c;
+}
+gint rectangleindex_row(RectangleIndex *ri, gdouble y) {
+	gint c;
+	c = (y - ri->box.y1) / ri->cellheight;
+	return c < 0 ? 0 : c >= ri->rows ? ri->rows - 1 : c;
 }
 
 /*
- * index of rectangle in a list overlapping another rectangle
+ * the functions on the arrays of coordinates are compiled both for the generic
+ * processor and for AVX2; the version used is chosen when the program starts,
+ * which requires the ifunc support of glibc
  */
-gint rectanglelist_overlap(RectangleList *rl, PopplerRectangle *r) {
-	 gint index;
-	 for (index = 0; index < rl->num; index++)
-		 if (rectangle_overlap(&rl->rect[index], r))
-			 return index;
-	 return -1;
-}
+#if defined(__GNUC__) && defined(__x86_64__) && defined(__GLIBC__)
+#define ARRAYSCLONES __attribute__((target_clones("avx2", "default")))
+#else
+#define ARRAYSCLONES
+#endif
 
 /*
- * sort a rectangle list by position, quick and approximate
+ * coordinates of the rectangles of a list in separate arrays
  */
-void rectanglelist_quicksort(RectangleList *rl, PopplerPage *page) {
-	(void) page;
-	qsort(rl->rect, rl->num, sizeof(PopplerRectangle),
-		(int (*)(const void *, const void *)) rectangle_compare);
+RectangleArrays *rectanglearrays_new(RectangleList *rl) {
+	RectangleArrays *ra;
+	gint i;
+
+	ra = malloc(sizeof(RectangleArrays));
+	ra->num = rl->num;
+	ra->x1 = malloc(MAX(rl->num, 1) * 4 * sizeof(gdouble));
+	ra->y1 = ra->x1 + MAX(rl->num, 1);
+	ra->x2 = ra->y1 + MAX(rl->num, 1);
+	ra->y2 = ra->x2 + MAX(rl->num, 1);
+	for (i = 0; i < rl->num; i++) {
+		ra->x1[i] = rl->rect[i].x1;
+		ra->y1[i] = rl->rect[i].y1;
+		ra->x2[i] = rl->rect[i].x2;
+		ra->y2[i] = rl->rect[i].y2;
+	}
+	return ra;
 }
 
 /*
- * sort a rectangle list by position, in two steps
+ * rectangle list from separate arrays of coordinates
  */
-void rectanglelist_twosort(RectangleList *rl, PopplerPage *page) {
-	int i, j;
-	int sorted;
-	PopplerRectangle *r, *s;
-	(void) page;
+RectangleList *rectanglearrays_list(RectangleArrays *ra) {
+	RectangleList *rl;
+	gint i;
 
-	/*
-	 * sort vertically if horizontally overlapping
-	 *
-	 * iteratively find the minimum among i+1...rl->num-1
-	 *
-	 * when replacing the current minimum restart since the order is not
-	 * transitively closed; e.g., {2, 0, 1} with 0<1 and 1<2 but not 0<2;
-	 * without the restart the current minimum starts as 2, is not replaced
-	 * by 0 but is then replaced by 1; minimum ends as 1 instead of 0
-	 */
-	for (i = 0; i < rl->num - 1; i++) {
-		r = &rl->rect[i];
-		for (j = i + 1; j < rl->num; j++) {
-			s = &rl->rect[j];
-			if (rectangle_htouch(r, s) &&
-			    rectangle_vcompare(r, s) == 1) {
-				r = s;
-				j = i; // order is not transitivity closed
-			}
-		}
-		rectangle_swap(&rl->rect[i], r);
-	}
-
-	/*
-	 * sort horizontally, but respect the previous ordering
-	 *
-	 * this step is correct for the same reason of regular bubblesort: the
-	 * first scan of the list moves the element that should go last at the
-	 * end of the list; the same for the other scans for the remaining part
-	 * of the list
-	 *
-	 * let k be the rectangle that should be placed last in the list: no
-	 * other rectangle is greater than it according to the order < of the
-	 * first step and no incomparable rectangle has greater x1
-	 *
-	 * the previous step placed all rectangles lower than k according to <
-	 * before k in the list; for example, if i<j<k then i is before j and j
-	 * is before k; the second step never swaps horizontally-overlapping
-	 * rectangles, so it does not move i ahead of j and j ahead of k; as a
-	 * result, k cannot be overtaken by a rectangle that is directly (like
-	 * j) or indirectly (like i) lower than it according to the order <; in
-	 * the same way, a rectangle that is incomparable with k cannot
-	 * overtake it since no incomparable rectangle has x1 larger than that
-	 * of k by assumption; all of this proves that when the element
-	 * preceding k is compared with k, they are not swapped
-	 *
-	 * as a result, the scan proceeds with k and not with its preceding
-	 * element; since the elements following k are incomparable with k
-	 * according to <, they all have lower x1; the scan therefore moves k
-	 * to the last position
-	 */
-	for (i = 0, sorted = 0; i < rl->num && ! sorted; i++) {
-		sorted = 1;
-		for (j = 0; j < rl->num - 1; j++) {
-			r = &rl->rect[j];
-			s = &rl->rect[j + 1];
-			if (rectangle_htouch(r, s))
-				continue;
-			if (rectangle_hcompare(r, s) != 1)
-				continue;
-			rectangle_swap(r, s);
-			sorted = 0;
-		}
+	rl = rectanglelist_new(MAX(ra->num, 1));
+	for (i = 0; i < ra->num; i++) {
+		rl->rect[i].x1 = ra->x1[i];
+		rl->rect[i].y1 = ra->y1[i];
+		rl->rect[i].x2 = ra->x2[i];
+		rl->rect[i].y2 = ra->y2[i];
 	}
+	rl->num = ra->num;
+	return rl;
 }
 
 /*
- * sort rectangles according to the order of their characters in the page
+ * free separate arrays of coordinates
  */
-void rectanglelist_charsort(RectangleList *rl, PopplerPage *page) {
-	PopplerRectangle *rect;
-	unsigned i, n;
-	int j, p;
-
-	poppler_page_get_text_layout(page, &rect, &n);
-	for (i = 0, p = 0; i < n && p < rl->num; i++)
-		for (j = p; j < rl->num; j++)
-			if (rectangle_contain(&rl->rect[j], &rect[i])) {
-				rectangle_swap(&rl->rect[p], &rl->rect[j]);
-				p++;
-				break;
-			}
-	g_free(rect);
+void rectanglearrays_free(RectangleArrays *ra) {
+	free(ra->x1);
+	free(ra);
 }
 
 /*
- * largest rectangle in a list
+ * mark the rectangles from..to-1 that contain, are contained in, touch or
+ * overlap another rectangle; return the number of marked rectangles
+ *
+ * the comparisons are the same as rectangle_contain(), rectangle_touch() and
+ * rectangle_overlap(), with the rectangle of the list as the first argument
  */
-PopplerRectangle *rectanglelist_largest(RectangleList *rl) {
-	PopplerRectangle *max;
-	gdouble maxarea, area;
-	int r;
+ARRAYSCLONES
+gint rectanglearrays_contain(RectangleArrays *ra, PopplerRectangle *r,
+		gint from, gint to, guchar *mask) {
+	const gdouble *x1 = ra->x1, *y1 = ra->y1, *x2 = ra->x2, *y2 = ra->y2;
+	gdouble rx1, ry1, rx2, ry2;
+	gint i, count;
+
+	rx1 = r->x1 + TOLERANCE;
+	ry1 = r->y1 + TOLERANCE;
+	rx2 = r->x2 - TOLERANCE;
+	ry2 = r->y2 - TOLERANCE;
+	count = 0;
+	for (i = from; i < to; i++) {
+		mask[i - from] =
+			(x1[i] <= rx1) & (rx2 <= x2[i]) &
+			(y1[i] <= ry1) & (ry2 <= y2[i]);
+		count += mask[i - from];
+	}
+	return count;
+}
+ARRAYSCLONES
+gint rectanglearrays_contained(RectangleArrays *ra, PopplerRectangle *r,
+		gint from, gint to, guchar *mask) {
+	const gdouble *x1 = ra->x1, *y1 = ra->y1, *x2 = ra->x2, *y2 = ra->y2;
+	gdouble rx1, ry1, rx2, ry2;
+	gint i, count;
+
+	rx1 = r->x1;
+	ry1 = r->y1;
+	rx2 = r->x2;
+	ry2 = r->y2;
+	count = 0;
+	for (i = from; i < to; i++) {
+		mask[i - from] =
+			(rx1 <= x1[i] + TOLERANCE) & (x2[i] - TOLERANCE <= rx2) &
+			(ry1 <= y1[i] + TOLERANCE) & (y2[i] - TOLERANCE <= ry2);
+		count += mask[i - from];
+	}
+	return count;
+}
+ARRAYSCLONES
+gint rectanglearrays_touch(RectangleArrays *ra, PopplerRectangle *r,
+		gint from, gint to, guchar *mask) {
+	const gdouble *x1 = ra->x1, *y1 = ra->y1, *x2 = ra->x2, *y2 = ra->y2;
+	gdouble rx1, ry1, rx2, ry2;
+	gint i, count;
+
+	rx1 = r->x1;
+	ry1 = r->y1;
+	rx2 = r->x2;
+	ry2 = r->y2;
+	count = 0;
+	for (i = from; i < to; i++) {
+		mask[i - from] =
+			! (x2[i] < rx1) & ! (x1[i] > rx2) &
+			! (y2[i] < ry1) & ! (y1[i] > ry2);
+		count += mask[i - from];
+	}
+	return count;
+}
+ARRAYSCLONES
+gint rectanglearrays_overlap(RectangleArrays *ra, PopplerRectangle *r,
+		gint from, gint to, guchar *mask) {
+	const gdouble *x1 = ra->x1, *y1 = ra->y1, *x2 = ra->x2, *y2 = ra->y2;
+	gdouble rx1, ry1, rx2, ry2;
+	gint i, count;
+
+	rx1 = r->x1;
+	ry1 = r->y1;
+	rx2 = r->x2;
+	ry2 = r->y2;
+	count = 0;
+	for (i = from; i < to; i++) {
+		mask[i - from] =
+			! (x2[i] <= rx1) & ! (x1[i] >= rx2) &
+			! (y2[i] <= ry1) & ! (y1[i] >= ry2);
+		count += mask[i - from];
+	}
+	return count;
+}
 
-	if (rl->num == 0)
+/*
+ * number of rectangles checked at time when scanning the arrays
+ */
+#define ARRAYSBLOCK 16
+
+/*
+ * index of the first rectangle from position "from" on in a relation to
+ * another, by scanning the arrays of coordinates; -1 if the relation has no
+ * array version or no rectangle is found
+ */
+gint rectanglearrays_find(RectangleArrays *ra, PopplerRectangle *r, gint from,
+		gboolean (*relation)(PopplerRectangle *, PopplerRectangle *),
+		gboolean *done) {
+	gint (*mark)(RectangleArrays *, PopplerRectangle *,
+		gint, gint, guchar *);
+	guchar mask[ARRAYSBLOCK];
+	gint index, to, i;
+
+	mark =	relation == rectangle_contain ? rectanglearrays_contain :
+		relation == rectangle_contained ? rectanglearrays_contained :
+		relation == rectangle_touch ? rectanglearrays_touch :
+		relation == rectangle_overlap ? rectanglearrays_overlap :
+		NULL;
+	*done = mark != NULL;
+	if (mark == NULL)
+		return -1;
+
+	for (index = from; index < ra->num; index = to) {
+		to = MIN(index + ARRAYSBLOCK, ra->num);
+		if (mark(ra, r, index, to, mask) == 0)
+			continue;
+		for (i = 0; i < to - index; i++)
+			if (mask[i])
+				return index + i;
+	}
+	return -1;
+}
+
+/*
+ * build the index of a rectangle list
+ */
+RectangleIndex *rectangleindex_new(RectangleList *rl) {
+	RectangleIndex *ri;
+	PopplerRectangle *r;
+	gint i, n, x, y, x1, y1, x2, y2, *pos;
+
+	ri = malloc(sizeof(RectangleIndex));
+	ri->rect = rl->rect;
+	ri->num = rl->num;
+	ri->arrays = rectanglearrays_new(rl);
+	if (rl->num < INDEXMIN) {
+		ri->cols = 0;
+		ri->rows = 0;
+		ri->start = NULL;
+		ri->cell = NULL;
+		return ri;
+	}
+
+	ri->box = rl->rect[0];
+	rectangle_normalize(&ri->box);
+	for (i = 1; i < rl->num; i++)
+		rectangle_join(&ri->box, &rl->rect[i]);
+	rectangle_expand(&ri->box, TOLERANCE, TOLERANCE);
+
+	for (n = 1; n * n < rl->num && n < 256; n++) {
+	}
+	ri->cols = n;
+	ri->rows = n;
+	ri->cellwidth = MAX(rectangle_width(&ri->box) / n, TOLERANCE);
+	ri->cellheight = MAX(rectangle_height(&ri->box) / n, TOLERANCE);
+
+	/* count the rectangles in each cell, then place them; since they are
+	 * placed in order, the rectangles in each cell are sorted by index */
+	n = ri->cols * ri->rows;
+	ri->start = calloc(n + 1, sizeof(gint));
+	for (i = 0; i < rl->num; i++) {
+		r = &rl->rect[i];
+		x1 = rectangleindex_col(ri, MIN(r->x1, r->x2) - TOLERANCE);
+		y1 = rectangleindex_row(ri, MIN(r->y1, r->y2) - TOLERANCE);
+		x2 = rectangleindex_col(ri, MAX(r->x1, r->x2) + TOLERANCE);
+		y2 = rectangleindex_row(ri, MAX(r->y1, r->y2) + TOLERANCE);
+		for (y = y1; y <= y2; y++)
+			for (x = x1; x <= x2; x++)
+				ri->start[y * ri->cols + x + 1]++;
+	}
+	for (i = 0; i < n; i++)
+		ri->start[i + 1] += ri->start[i];
+
+	ri->cell = malloc(MAX(ri->start[n], 1) * sizeof(gint));
+	pos = malloc(n * sizeof(gint));
+	memcpy(pos, ri->start, n * sizeof(gint));
+	for (i = 0; i < rl->num; i++) {
+		r = &rl->rect[i];
+		x1 = rectangleindex_col(ri, MIN(r->x1, r->x2) - TOLERANCE);
+		y1 = rectangleindex_row(ri, MIN(r->y1, r->y2) - TOLERANCE);
+		x2 = rectangleindex_col(ri, MAX(r->x1, r->x2) + TOLERANCE);
+		y2 = rectangleindex_row(ri, MAX(r->y1, r->y2) + TOLERANCE);
+		for (y = y1; y <= y2; y++)
+			for (x = x1; x <= x2; x++)
+				ri->cell[pos[y * ri->cols + x]++] = i;
+	}
+	free(pos);
+
+	return ri;
+}
+
+/*
+ * drop the index of a rectangle list
+ */
+void rectanglelist_unindex(RectangleList *rl) {
+	if (rl->index == NULL)
+		return;
+	free(rl->index->start);
+	free(rl->index->cell);
+	rectanglearrays_free(rl->index->arrays);
+	free(rl->index);
+	rl->index = NULL;
+}
+
+/*
+ * index of the first rectangle in a list from position "from" on that is in a
+ * relation with another rectangle; the relation implies that they touch
+ */
+gint rectanglelist_find(RectangleList *rl, PopplerRectangle *r, gint from,
+		gboolean (*relation)(PopplerRectangle *, PopplerRectangle *)) {
+	RectangleIndex *ri;
+	gint index, found, x, y, x1, y1, x2, y2, c, i;
+	gboolean done;
+
+	if (rl->num == 0 || from >= rl->num)
+		return -1;
+
+	if (rl->index != NULL &&
+	    (rl->index->rect != rl->rect || rl->index->num != rl->num))
+		rectanglelist_unindex(rl);
+	if (rl->index == NULL) {
+		rl->index = rectangleindex_new(rl);
+		rectanglestats.indexes++;
+	}
+	ri = rl->index;
+
+	if (rl->num < INDEXMIN || r->x1 > r->x2 || r->y1 > r->y2) {
+		index = rectanglearrays_find(ri->arrays, r, from,
+			relation, &done);
+		if (done)
+			return index;
+		for (index = from; index < rl->num; index++)
+			if (relation(&rl->rect[index], r))
+				return index;
+		return -1;
+	}
+
+	if (r->x2 + TOLERANCE < ri->box.x1 || r->x1 - TOLERANCE > ri->box.x2 ||
+	    r->y2 + TOLERANCE < ri->box.y1 || r->y1 - TOLERANCE > ri->box.y2)
+		return -1;
+
+	x1 = rectangleindex_col(ri, r->x1 - TOLERANCE);
+	y1 = rectangleindex_row(ri, r->y1 - TOLERANCE);
+	x2 = rectangleindex_col(ri, r->x2 + TOLERANCE);
+	y2 = rectangleindex_row(ri, r->y2 + TOLERANCE);
+
+	found = -1;
+	for (y = y1; y <= y2; y++)
+		for (x = x1; x <= x2; x++) {
+			c = y * ri->cols + x;
+			for (i = ri->start[c]; i < ri->start[c + 1]; i++) {
+				index = ri->cell[i];
+				if (index < from)
+					continue;
+				if (found != -1 && index >= found)
+					break;
+				if (relation(&rl->rect[index], r)) {
+					found = index;
+					break;
+				}
+			}
+		}
+
+	return found;
+}
+
+/*
+ * index of rectangle in a list containing another rectangle
+ */
+gint rectanglelist_contain(RectangleList *rl, PopplerRectangle *r) {
+	return rectanglelist_find(rl, r, 0, rectangle_contain);
+}
+
+/*
+ * index of rectangle in a list touching another rectangle
+ */
+gint rectanglelist_touch(RectangleList *rl, PopplerRectangle *r) {
+	return rectanglelist_find(rl, r, 0, rectangle_touch);
+}
+
+/*
+ * index of rectangle in a list overlapping another rectangle
+ */
+gint rectanglelist_overlap(RectangleList *rl, PopplerRectangle *r) {
+	return rectanglelist_find(rl, r, 0, rectangle_overlap);
+}
+
+/*
+ * a rectangle along with its position in a list, compared by x1
+ */
+typedef struct {
+	PopplerRectangle rect;
+	gint n;
+} RectangleNumbered;
+
+int rectanglenumbered_hcompare(const void *a, const void *b) {
+	return rectangle_hcompare(&((RectangleNumbered *) a)->rect,
+	                          &((RectangleNumbered *) b)->rect);
+}
+
+/*
+ * sort a rectangle list by position, quick and approximate
+ */
+void rectanglelist_quicksort(RectangleList *rl, PopplerPage *page) {
+	gint64 timing;
+
+	(void) page;
+	timing = pagetiming_now();
+	rectanglelist_unindex(rl);
+	qsort(rl->rect, rl->num, sizeof(PopplerRectangle),
+		(int (*)(const void *, const void *)) rectangle_compare);
+	pagetiming_stage(STAGE_SORT, timing, rl->num);
+}
+
+/*
+ * sort a rectangle list by position, in two steps
+ *
+ * first, the pairs of horizontally touching rectangles are found by a sweep
+ * line over the rectangles sorted by x1; each pair is an arc of a graph from
+ * the rectangle of lower y1 to the other; second, the rectangles are output
+ * in a topological order of this graph: among the rectangles with no arc
+ * from a rectangle still to be output, the next is the one of minimal x1, or
+ * the first in the list if more have the same
+ *
+ * the first step is the order < of horizontally touching rectangles by y1;
+ * the second extends it with the order of x1 for incomparable rectangles;
+ * the cost is O(n log n + p log n), where p is the number of pairs of
+ * horizontally touching rectangles
+ */
+gboolean rectanglelist_twosort_before(RectangleList *rl, gint a, gint b) {
+	return rl->rect[a].x1 < rl->rect[b].x1 ||
+		(rl->rect[a].x1 == rl->rect[b].x1 && a < b);
+}
+
+void rectanglelist_twosort_push(RectangleList *rl, gint *heap, gint *n,
+		gint e) {
+	gint i;
+	for (i = (*n)++;
+	     i > 0 && rectanglelist_twosort_before(rl, e, heap[(i - 1) / 2]);
+	     i = (i - 1) / 2)
+		heap[i] = heap[(i - 1) / 2];
+	heap[i] = e;
+}
+
+gint rectanglelist_twosort_pop(RectangleList *rl, gint *heap, gint *n) {
+	gint top, last, i, c;
+	top = heap[0];
+	last = heap[--(*n)];
+	for (i = 0; (c = 2 * i + 1) < *n; i = c) {
+		if (c + 1 < *n &&
+		    rectanglelist_twosort_before(rl, heap[c + 1], heap[c]))
+			c++;
+		if (! rectanglelist_twosort_before(rl, heap[c], last))
+			break;
+		heap[i] = heap[c];
+	}
+	heap[i] = last;
+	return top;
+}
+
+void rectanglelist_twosort(RectangleList *rl, PopplerPage *page) {
+	RectangleNumbered *sorted;
+	gint *active, nactive, *pair, npair, maxpair;
+	gint *degree, *start, *arc, *heap, nheap;
+	PopplerRectangle *result, *r, *s;
+	gint i, j, k, a, b;
+	gint64 timing;
+	(void) page;
+
+	if (rl->num <= 1)
+		return;
+	timing = pagetiming_now();
+	rectanglelist_unindex(rl);
+
+	/* pairs of horizontally touching rectangles, as arcs a -> b */
+	sorted = malloc(rl->num * sizeof(RectangleNumbered));
+	for (i = 0; i < rl->num; i++) {
+		rectangle_copy(&sorted[i].rect, rl->rect + i);
+		sorted[i].n = i;
+	}
+	qsort(sorted, rl->num, sizeof(RectangleNumbered),
+		rectanglenumbered_hcompare);
+
+	maxpair = rl->num;
+	pair = malloc(maxpair * 2 * sizeof(gint));
+	npair = 0;
+	active = malloc(rl->num * sizeof(gint));
+	nactive = 0;
+	for (i = 0; i < rl->num; i++) {
+		s = &sorted[i].rect;
+		for (j = 0, k = 0; j < nactive; j++) {
+			r = &sorted[active[j]].rect;
+			if (r->x2 < s->x1)
+				continue;
+			active[k++] = active[j];
+			if (! rectangle_htouch(r, s))
+				continue;
+			switch (rectangle_vcompare(r, s)) {
+			case -1:
+				a = sorted[active[j]].n;
+				b = sorted[i].n;
+				break;
+			case 1:
+				a = sorted[i].n;
+				b = sorted[active[j]].n;
+				break;
+			default:
+				continue;
+			}
+			if (npair >= maxpair) {
+				maxpair *= 2;
+				pair = realloc(pair, maxpair * 2 * sizeof(gint));
+			}
+			pair[2 * npair] = a;
+			pair[2 * npair + 1] = b;
+			npair++;
+		}
+		active[k++] = i;
+		nactive = k;
+	}
+	free(active);
+	free(sorted);
+
+	/* arcs from each rectangle, and number of arcs to each */
+	degree = calloc(rl->num, sizeof(gint));
+	start = calloc(rl->num + 1, sizeof(gint));
+	for (i = 0; i < npair; i++) {
+		start[pair[2 * i] + 1]++;
+		degree[pair[2 * i + 1]]++;
+	}
+	for (i = 0; i < rl->num; i++)
+		start[i + 1] += start[i];
+	arc = malloc(MAX(npair, 1) * sizeof(gint));
+	heap = malloc(rl->num * sizeof(gint));
+	memcpy(heap, start, rl->num * sizeof(gint));
+	for (i = 0; i < npair; i++)
+		arc[heap[pair[2 * i]]++] = pair[2 * i + 1];
+	free(pair);
+
+	/* topological order, by x1 among the rectangles with no arc to them */
+	nheap = 0;
+	for (i = 0; i < rl->num; i++)
+		if (degree[i] == 0)
+			rectanglelist_twosort_push(rl, heap, &nheap, i);
+	result = malloc(rl->num * sizeof(PopplerRectangle));
+	for (k = 0; nheap > 0; k++) {
+		i = rectanglelist_twosort_pop(rl, heap, &nheap);
+		rectangle_copy(result + k, rl->rect + i);
+		for (j = start[i]; j < start[i + 1]; j++)
+			if (--degree[arc[j]] == 0)
+				rectanglelist_twosort_push(rl,
+					heap, &nheap, arc[j]);
+	}
+	memcpy(rl->rect, result, rl->num * sizeof(PopplerRectangle));
+
+	free(result);
+	free(heap);
+	free(arc);
+	free(start);
+	free(degree);
+	pagetiming_stage(STAGE_SORT, timing, rl->num);
+}
+
+/*
+ * sort rectangles according to the order of the characters in a layout
+ *
+ * for each character, the first block from position p on containing it is
+ * moved to position p; the blocks containing the character are found by the
+ * index of a copy of the list, their positions are tracked in pos[]
+ */
+void rectanglelist_charsort_layout(RectangleList *rl,
+		PopplerRectangle *rect, guint n) {
+	RectangleList *blocks;
+	gint *pos, *at, p, j, k, m;
+	guint i;
+	gint64 timing;
+
+	if (rl->num <= 1)
+		return;
+	timing = pagetiming_now();
+	rectanglelist_unindex(rl);
+
+	blocks = rectanglelist_copy(rl);
+	pos = malloc(rl->num * sizeof(gint));
+	at = malloc(rl->num * sizeof(gint));
+	for (j = 0; j < rl->num; j++) {
+		pos[j] = j;
+		at[j] = j;
+	}
+
+	for (i = 0, p = 0; i < n && p < rl->num; i++) {
+		m = -1;
+		for (k = rectanglelist_find(blocks, &rect[i], 0,
+				rectangle_contain);
+		     k != -1;
+		     k = rectanglelist_find(blocks, &rect[i], k + 1,
+				rectangle_contain))
+			if (pos[k] >= p && (m == -1 || pos[k] < pos[m]))
+				m = k;
+		if (m == -1)
+			continue;
+		j = pos[m];
+		rectangle_swap(&rl->rect[p], &rl->rect[j]);
+		k = at[p];
+		at[j] = k;
+		pos[k] = j;
+		at[p] = m;
+		pos[m] = p;
+		p++;
+	}
+
+	free(at);
+	free(pos);
+	rectanglelist_free(blocks);
+	pagetiming_stage(STAGE_SORT, timing, rl->num);
+}
+
+/*
+ * sort rectangles according to the order of their characters in the page
+ */
+void rectanglelist_charsort_pagetext(RectangleList *rl, PageText *pt) {
+	PopplerRectangle *rect;
+	guint n;
+
+	rect = pagetext_layout(pt, &n);
+	rectanglelist_charsort_layout(rl, rect, n);
+}
+
+void rectanglelist_charsort(RectangleList *rl, PopplerPage *page) {
+	PageText *pt;
+
+	pt = pagetext_new(page);
+	rectanglelist_charsort_pagetext(rl, pt);
+	pagetext_free(pt);
+}
+
+/*
+ * sort a rectangle list: 0 = quicksort, 1 = twosort, 2 = charsort
+ */
+void rectanglelist_sort_pagetext(RectangleList *rl, PageText *pt, int order) {
+	switch (order) {
+	case 0:
+		rectanglelist_quicksort(rl, pt->page);
+		break;
+	case 1:
+		rectanglelist_twosort(rl, pt->page);
+		break;
+	case 2:
+		rectanglelist_charsort_pagetext(rl, pt);
+		break;
+	}
+}
+
+/*
+ * largest rectangle in a list
+ */
+PopplerRectangle *rectanglelist_largest(RectangleList *rl) {
+	PopplerRectangle *max;
+	gdouble maxarea, area;
+	int r;
+
+	if (rl->num == 0)
 		return NULL;
 	max = &rl->rect[0];
 	maxarea = rectangle_area(max);
@@ -811,6 +1920,7 @@ PopplerRectangle *rectanglelist_largest(RectangleList *rl) {
  * sort rectangles by area
  */
 void rectanglelist_areasort(RectangleList *rl) {
+	rectanglelist_unindex(rl);
 	qsort(rl->rect, rl->num, sizeof(PopplerRectangle),
 		(int (*)(const void *, const void *)) rectangle_areacompare);
 }
@@ -898,108 +2008,876 @@ gboolean rectanglelist_subtract_append(RectangleList *dest,
 }
 
 /*
- * subtract a rectangle list from another: orig -= sub
+ * subtract a rectangle list from another, one rectangle at time
+ *
+ * the result of each step goes to a list that is then swapped with the
+ * original, so that the two lists are reused rather than allocated anew
  */
-gboolean rectanglelist_subtract(RectangleList **orig, RectangleList *sub,
+gboolean rectanglelist_subtract_incremental(RectangleList **orig,
+		RectangleList *sub,
 		PopplerRectangle *cont, RectangleBound *b) {
-	RectangleList *dest;
+	RectangleList *dest, *swap;
 	gint r;
-	RectangleBound bd = {0.0, 0.0};
 
+	dest = rectanglelist_new(MAXRECT);
 	for (r = 0; r < sub->num; r++) {
-		dest = rectanglelist_new(MAXRECT);
+		rectanglelist_clear(dest);
 		if (! rectanglelist_subtract_append(dest, *orig, sub->rect + r,
-		                                    cont, b != NULL ? b : &bd))
+		                                    cont, b)) {
+			rectanglelist_free(dest);
 			return FALSE;
+		}
 		if (debugtextrectangles == -1 && dest->num != (*orig)->num)
 			printf("rectangles: %d\n", dest->num);
-		rectanglelist_free(*orig);
+		swap = *orig;
 		*orig = dest;
+		dest = swap;
+	}
+	rectanglelist_free(dest);
+
+	return TRUE;
+}
+
+/*
+ * subtract a rectangle list from another, by a sweep line from top to bottom
+ */
+gboolean rectanglelist_subtract_sweep(RectangleList **orig,
+		RectangleList *sub,
+		PopplerRectangle *cont, RectangleBound *b) {
+	RectangleList *sorted, *active, *next, *cut, *done, *swap;
+	PopplerRectangle *s, *a;
+	gint r, i, n;
+
+	if (sub->num == 0)
+		return TRUE;
+
+	sorted = rectanglelist_copy(sub);
+	qsort(sorted->rect, sorted->num, sizeof(PopplerRectangle),
+		(int (*)(const void *, const void *)) rectangle_vcompare);
+
+	active = rectanglelist_new(MAXRECT);
+	next = rectanglelist_new(MAXRECT);
+	cut = rectanglelist_new(MAXRECT);
+	done = rectanglelist_new(MAXRECT);
+
+	for (i = 0; i < (*orig)->num; i++)
+		if (rectangle_boundcontain((*orig)->rect + i, cont, b))
+			rectanglelist_add(active, (*orig)->rect + i);
+
+	for (r = 0; r < sorted->num; r++) {
+		s = sorted->rect + r;
+		n = active->num + done->num;
+
+		/* the active rectangles ending above s are not overlapped by s
+		 * nor by the following subtracted rectangles, which all begin
+		 * below s; the others are retained if they do not overlap s,
+		 * otherwise they are cut */
+		rectanglelist_clear(next);
+		rectanglelist_clear(cut);
+		for (i = 0; i < active->num; i++) {
+			a = active->rect + i;
+			if (a->y2 + TOLERANCE < s->y1)
+				rectanglelist_append(done, a);
+			else if (! rectangle_overlap(a, s))
+				rectanglelist_append(next, a);
+			else
+				rectanglelist_append(cut, a);
+		}
+		if (! rectanglelist_subtract_append(next, cut, s, cont, b))
+			break;
+
+		swap = active;
+		active = next;
+		next = swap;
+
+		if (debugtextrectangles == -1 && active->num + done->num != n)
+			printf("rectangles: %d\n", active->num + done->num);
+	}
+
+	for (i = 0; i < active->num; i++)
+		rectanglelist_append(done, active->rect + i);
+
+	rectanglelist_free(sorted);
+	rectanglelist_free(active);
+	rectanglelist_free(next);
+	rectanglelist_free(cut);
+
+	if (r < sub->num) {
+		rectanglelist_free(done);
+		return FALSE;
+	}
+
+	rectanglelist_free(*orig);
+	*orig = done;
+	return TRUE;
+}
+
+/*
+ * subtract a rectangle list from another: orig -= sub
+ */
+gboolean rectanglelist_subtract(RectangleList **orig, RectangleList *sub,
+		PopplerRectangle *cont, RectangleBound *b) {
+	RectangleBound bd = {0.0, 0.0};
+
+	if (b == NULL)
+		b = &bd;
+
+	return subtractmethod == 0 ?
+		rectanglelist_subtract_incremental(orig, sub, cont, b) :
+		rectanglelist_subtract_sweep(orig, sub, cont, b);
+}
+
+/*
+ * subtract a rectangle list from a single rectangle: res = r - rl
+ */
+RectangleList *rectanglelist_subtract1(PopplerRectangle *r, RectangleList *rl,
+		PopplerRectangle *cont, RectangleBound *b) {
+	RectangleList *res;
+
+	res = rectanglelist_new(MAXRECT);
+	rectangle_copy(res->rect, r);
+	res->num = 1;
+
+	if (! rectanglelist_subtract(&res, rl, cont, b)) {
+		rectanglelist_free(res);
+		return NULL;
+	}
+	return res;
+}
+
+/*
+ * join consecutive touching rectangles of a list
+ */
+void rectanglelist_consecutive(RectangleList *orig) {
+	gint i, j;
+
+	if (orig->num == 0)
+		return;
+	rectanglelist_unindex(orig);
+
+	for (j = 0, i = 1; i < orig->num; i++)
+		if (rectangle_touch(orig->rect + j, orig->rect + i))
+			rectangle_join(orig->rect + j, orig->rect + i);
+		else {
+			j++;
+			rectangle_copy(orig->rect + j, orig->rect + i);
+		}
+	orig->num = j + 1;
+}
+
+/*
+ * join touching rectangles in a rectangle list
+ *
+ * the rectangles are sorted by their left side, so that those touching each
+ * are found by a sweep line from left to right: the active rectangles are the
+ * ones not ending before the current one begins; each touching pair is
+ * recorded in a union-find forest, and each resulting group is then replaced
+ * by its enclosing rectangle, at the position of its first element
+ *
+ * the enclosing rectangles of two groups may touch even if no two of their
+ * elements do, for example:
+ *	1 2
+ *	  3
+ *	654
+ * rectangle 1 does not touch any else, but the group of 2, 3, 4, 5 and 6
+ * makes a rectangle that includes it; this is why the procedure is repeated
+ * until no group of more than one rectangle is found; since joining is
+ * monotonic, the result is the same as joining pairs in any order
+ */
+gint unionfind_root(gint *parent, gint i) {
+	while (parent[i] != i) {
+		parent[i] = parent[parent[i]];
+		i = parent[i];
+	}
+	return i;
+}
+
+gboolean unionfind_union(gint *parent, gint i, gint j) {
+	i = unionfind_root(parent, i);
+	j = unionfind_root(parent, j);
+	if (i == j)
+		return FALSE;
+	if (i < j)
+		parent[j] = i;
+	else
+		parent[i] = j;
+	return TRUE;
+}
+
+gboolean rectanglelist_joinstep(RectangleList *orig) {
+	RectangleNumbered *sorted;
+	gint *parent, *active, nactive, *position;
+	gint i, j, k, n, root;
+	gboolean joined;
+
+	if (orig->num <= 1)
+		return FALSE;
+
+	sorted = malloc(orig->num * sizeof(RectangleNumbered));
+	for (i = 0; i < orig->num; i++) {
+		rectangle_copy(&sorted[i].rect, orig->rect + i);
+		sorted[i].n = i;
+	}
+	qsort(sorted, orig->num, sizeof(RectangleNumbered),
+		rectanglenumbered_hcompare);
+
+	parent = malloc(orig->num * sizeof(gint));
+	for (i = 0; i < orig->num; i++)
+		parent[i] = i;
+
+	active = malloc(orig->num * sizeof(gint));
+	nactive = 0;
+	joined = FALSE;
+	for (i = 0; i < orig->num; i++) {
+		for (j = 0, k = 0; j < nactive; j++) {
+			if (sorted[active[j]].rect.x2 < sorted[i].rect.x1)
+				continue;
+			active[k++] = active[j];
+			if (rectangle_touch(&sorted[active[j]].rect,
+			                    &sorted[i].rect) &&
+			    unionfind_union(parent,
+			                    sorted[active[j]].n, sorted[i].n))
+				joined = TRUE;
+		}
+		active[k++] = i;
+		nactive = k;
+	}
+	free(active);
+	free(sorted);
+
+	if (! joined) {
+		free(parent);
+		return FALSE;
+	}
+
+	/* the root of a group is its first element; its position in the
+	 * result does not exceed the index of any later element, so the list
+	 * can be overwritten while scanning it */
+	position = malloc(orig->num * sizeof(gint));
+	for (i = 0, n = 0; i < orig->num; i++) {
+		root = unionfind_root(parent, i);
+		if (root == i) {
+			position[i] = n;
+			rectangle_copy(orig->rect + n, orig->rect + i);
+			n++;
+		}
+		else
+			rectangle_join(orig->rect + position[root],
+				orig->rect + i);
+	}
+	orig->num = n;
+	free(position);
+	free(parent);
+	return TRUE;
+}
+
+void rectanglelist_join(RectangleList *orig) {
+	rectanglelist_unindex(orig);
+	while (rectanglelist_joinstep(orig))
+		;
+}
+
+/*
+ * page cache
+ *
+ * a file for each page: a header, the rectangles of the characters, the
+ * attributes, the textareas, the text and the names of the fonts; numbers
+ * are in the byte order of the machine; mapped in memory when read, so that
+ * the text and the rectangles are used in place
+ *
+ * the file of a page is named after the md5 of the permanent and update ids
+ * of the document and the number of the page; each hit renews its time, the
+ * least recently used are removed when the files exceed the size limit
+ *
+ * a file is written to a temporary with the same name followed by .tmp and
+ * then renamed; temporaries left by an interrupted program are removed when
+ * older than an hour
+ */
+char *pagecachedir = NULL;
+long pagecachesize = 0;
+__thread char pagecachekey[33] = "";
+__thread long pagecachewritten = 0;
+
+#define PAGECACHE_MAGIC "pdfpage"
+#define PAGECACHE_VERSION 1
+#define PAGECACHE_ORDER 0x01020304
+#define PAGECACHE_SIZE (64 * 1024 * 1024)
+#define PAGECACHE_TMPAGE (60 * 60)
+#define PAGECACHE_ROWS 256
+
+struct pagecacheheader {
+	char magic[8];
+	guint32 version;
+	guint32 order;
+	guint32 num;		/* rectangles of characters */
+	guint32 nattributes;
+	guint32 nareas;
+	guint32 textlen;	/* text, without the final zero */
+	guint32 fontlen;	/* font names, each zero-terminated */
+	guint32 flags;
+};
+
+#define PAGECACHE_ATTRIBUTES 0x01	/* attributes stored */
+
+struct pagecacheattribute {
+	gint32 start;
+	gint32 end;
+	gdouble size;
+	guint16 red, green, blue;
+	guint16 underlined;
+	guint32 font;		/* offset in the font names */
+	guint32 pad;
+};
+
+struct pagecachearea {
+	gint32 kind;
+	guint32 num;
+	gdouble distance;
+};
+
+/*
+ * directory and size of the cache
+ */
+char *pagecache_directory() {
+	return pagecachedir != NULL ? pagecachedir : getenv("PDFPAGECACHE");
+}
+
+long pagecache_limit() {
+	char *env;
+
+	if (pagecachesize > 0)
+		return pagecachesize;
+	env = getenv("PDFPAGECACHESIZE");
+	if (env != NULL && atol(env) > 0)
+		return atol(env) * 1024 * 1024;
+	return PAGECACHE_SIZE;
+}
+
+/*
+ * remove the least recently used files until the cache fits its size
+ */
+struct pagecacheentry {
+	char *name;
+	off_t size;
+	time_t time;
+};
+
+int pagecache_entrycompare(const void *a, const void *b) {
+	const struct pagecacheentry *ea = a, *eb = b;
+	return ea->time < eb->time ? -1 : ea->time > eb->time ? 1 : 0;
+}
+
+gboolean pagecache_isfile(char *name) {
+	return strspn(name, "0123456789abcdef") == 32 && name[32] == '-' &&
+		name[33] != '\0' &&
+		strspn(name + 33, "0123456789") == strlen(name + 33);
+}
+
+gboolean pagecache_istemp(char *name) {
+	size_t digits;
+	if (strspn(name, "0123456789abcdef") != 32 || name[32] != '-')
+		return FALSE;
+	digits = strspn(name + 33, "0123456789");
+	return digits > 0 && ! strncmp(name + 33 + digits, ".tmp.", 5);
+}
+
+void pagecache_evict(char *dir) {
+	DIR *d;
+	struct dirent *de;
+	struct stat st;
+	struct pagecacheentry *entry;
+	int n, max, i;
+	long total, limit;
+	char *path;
+	gboolean temp;
+	time_t now;
+
+	d = opendir(dir);
+	if (d == NULL)
+		return;
+	n = 0;
+	max = 64;
+	entry = malloc(max * sizeof(struct pagecacheentry));
+	total = 0;
+	now = time(NULL);
+	while ((de = readdir(d)) != NULL) {
+		temp = pagecache_istemp(de->d_name);
+		if (! temp && ! pagecache_isfile(de->d_name))
+			continue;
+		path = g_strdup_printf("%s/%s", dir, de->d_name);
+		if (stat(path, &st) == -1) {
+			g_free(path);
+			continue;
+		}
+		if (temp) {
+			/* possibly being written by another program */
+			if (now - st.st_mtime > PAGECACHE_TMPAGE)
+				unlink(path);
+			else
+				total += st.st_size;
+			g_free(path);
+			continue;
+		}
+		if (n >= max) {
+			max *= 2;
+			entry = realloc(entry,
+				max * sizeof(struct pagecacheentry));
+		}
+		entry[n].name = path;
+		entry[n].size = st.st_size;
+		entry[n].time = st.st_mtime;
+		total += st.st_size;
+		n++;
+	}
+	closedir(d);
+
+	limit = pagecache_limit();
+	if (total > limit) {
+		qsort(entry, n, sizeof(struct pagecacheentry),
+			pagecache_entrycompare);
+		for (i = 0; i < n && total > limit; i++)
+			if (unlink(entry[i].name) == 0)
+				total -= entry[i].size;
+	}
+
+	for (i = 0; i < n; i++)
+		g_free(entry[i].name);
+	free(entry);
+	pagecachewritten = 0;
+}
+
+/*
+ * the document the pages of this thread are from
+ */
+void pagecache_document(PopplerDocument *doc) {
+	char *dir, *key;
+	gchar *permanent_id, *update_id;
+	guchar id[64];
+
+	pagecachekey[0] = '\0';
+	dir = pagecache_directory();
+	if (doc == NULL || dir == NULL || dir[0] == '\0')
+		return;
+	if (! poppler_document_get_id(doc, &permanent_id, &update_id))
+		return;
+	memcpy(id, permanent_id, 32);
+	memcpy(id + 32, update_id, 32);
+	g_free(permanent_id);
+	g_free(update_id);
+
+	if (g_mkdir_with_parents(dir, 0700) == -1)
+		return;
+	key = g_compute_checksum_for_data(G_CHECKSUM_MD5, id, 64);
+	strncpy(pagecachekey, key, 32);
+	pagecachekey[32] = '\0';
+	g_free(key);
+
+	pagecache_evict(dir);
+}
+
+/*
+ * read the file of a page, if any and valid
+ */
+gboolean pagecache_load(PageText *pt) {
+	int fd;
+	struct stat st;
+	char *map, *fonts;
+	size_t size, pos, len;
+	struct pagecacheheader *h;
+	struct pagecacheattribute *a;
+	struct pagecachearea *c;
+	PopplerTextAttributes *attr;
+	guint i;
+
+	fd = open(pt->cachefile, O_RDONLY);
+	if (fd == -1)
+		return FALSE;
+	if (fstat(fd, &st) == -1 ||
+	    (size_t) st.st_size < sizeof(struct pagecacheheader)) {
+		close(fd);
+		return FALSE;
+	}
+	size = st.st_size;
+	map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED)
+		return FALSE;
+
+				/* check header and sizes */
+
+	h = (struct pagecacheheader *) map;
+	if (memcmp(h->magic, PAGECACHE_MAGIC, 8) ||
+	    h->version != PAGECACHE_VERSION || h->order != PAGECACHE_ORDER ||
+	    h->nareas > PAGECACHE_AREAS) {
+		munmap(map, size);
+		return FALSE;
+	}
+	pos = sizeof(struct pagecacheheader) +
+		h->num * sizeof(PopplerRectangle) +
+		h->nattributes * sizeof(struct pagecacheattribute);
+	for (i = 0; i < h->nareas && pos + sizeof(struct pagecachearea) <= size;
+	     i++) {
+		c = (struct pagecachearea *) (map + pos);
+		pos += sizeof(struct pagecachearea) +
+			c->num * sizeof(PopplerRectangle);
+	}
+	if (i < h->nareas ||
+	    pos + h->textlen + 1 + h->fontlen != size ||
+	    map[pos + h->textlen] != '\0' ||
+	    (h->fontlen > 0 && map[size - 1] != '\0')) {
+		munmap(map, size);
+		return FALSE;
+	}
+
+				/* a rectangle for each character, attributes
+				 * within the characters */
+
+	if (! g_utf8_validate(map + pos, h->textlen, NULL) ||
+	    g_utf8_strlen(map + pos, h->textlen) != (glong) h->num) {
+		munmap(map, size);
+		return FALSE;
+	}
+	a = (struct pagecacheattribute *) (map +
+		sizeof(struct pagecacheheader) +
+		h->num * sizeof(PopplerRectangle));
+	for (i = 0; i < h->nattributes; i++)
+		if (a[i].start < 0 || a[i].end < 0 ||
+		    (guint) a[i].start >= h->num ||
+		    (guint) a[i].end >= h->num)
+			break;
+	if (i < h->nattributes) {
+		munmap(map, size);
+		return FALSE;
+	}
+
+				/* text and rectangles, in place */
+
+	pt->map = map;
+	pt->mapsize = size;
+	pos = sizeof(struct pagecacheheader);
+	pt->rect = (PopplerRectangle *) (map + pos);
+	pt->num = h->num;
+	pt->layout = TRUE;
+	pos += h->num * sizeof(PopplerRectangle);
+
+				/* attributes */
+
+	a = (struct pagecacheattribute *) (map + pos);
+	fonts = map + size - h->fontlen;
+	for (i = 0; i < h->nattributes; i++) {
+		attr = poppler_text_attributes_new();
+		attr->font_name = g_strdup(a[i].font < h->fontlen ?
+			fonts + a[i].font : "");
+		attr->font_size = a[i].size;
+		attr->is_underlined = a[i].underlined;
+		attr->color.red = a[i].red;
+		attr->color.green = a[i].green;
+		attr->color.blue = a[i].blue;
+		attr->start_index = a[i].start;
+		attr->end_index = a[i].end;
+		pt->attributes = g_list_prepend(pt->attributes, attr);
+	}
+	pt->attributes = g_list_reverse(pt->attributes);
+	pt->attributed = (h->flags & PAGECACHE_ATTRIBUTES) != 0;
+	pos += h->nattributes * sizeof(struct pagecacheattribute);
+
+				/* textareas */
+
+	for (i = 0; i < h->nareas; i++) {
+		c = (struct pagecachearea *) (map + pos);
+		pos += sizeof(struct pagecachearea);
+		len = c->num * sizeof(PopplerRectangle);
+		pt->area[i].kind = c->kind;
+		pt->area[i].distance = c->distance;
+		pt->area[i].rl = rectanglelist_new(c->num);
+		memcpy(pt->area[i].rl->rect, map + pos, len);
+		pt->area[i].rl->num = c->num;
+		pos += len;
+	}
+	pt->nareas = h->nareas;
+
+				/* text */
+
+	pt->text = map + pos;
+
+	utime(pt->cachefile, NULL);
+	return TRUE;
+}
+
+/*
+ * write the file of a page
+ */
+void pagecache_save(PageText *pt) {
+	struct pagecacheheader h;
+	struct pagecacheattribute a;
+	struct pagecachearea c;
+	PopplerTextAttributes *attr;
+	PopplerRectangle *rect;
+	GList *attributes, *l;
+	char *text, *tmp, *font;
+	guint num;
+	gint i;
+	FILE *fd;
+	gboolean ok;
+	long written;
+
+	/* only what is already fetched: the file would be incomplete if the
+	 * text or the layout were not; poppler is not called from here */
+	if (pt->text == NULL || ! pt->layout)
+		return;
+	text = pt->text;
+	rect = pt->rect;
+	num = pt->num;
+	attributes = pt->attributes;
+
+	memset(&h, 0, sizeof(h));
+	memcpy(h.magic, PAGECACHE_MAGIC, 8);
+	h.version = PAGECACHE_VERSION;
+	h.order = PAGECACHE_ORDER;
+	h.num = num;
+	h.nattributes = g_list_length(attributes);
+	h.nareas = pt->nareas;
+	h.textlen = strlen(text);
+	h.fontlen = 0;
+	h.flags = pt->attributed ? PAGECACHE_ATTRIBUTES : 0;
+	for (l = attributes; l != NULL; l = l->next) {
+		attr = (PopplerTextAttributes *) l->data;
+		font = attr->font_name == NULL ? "" : attr->font_name;
+		h.fontlen += strlen(font) + 1;
+	}
+
+	tmp = g_strdup_printf("%s.tmp.%d.%p", pt->cachefile, getpid(),
+		(void *) pt);
+	fd = fopen(tmp, "w");
+	if (fd == NULL) {
+		g_free(tmp);
+		return;
+	}
+
+	fwrite(&h, sizeof(h), 1, fd);
+	fwrite(rect, sizeof(PopplerRectangle), num, fd);
+	memset(&a, 0, sizeof(a));
+	for (l = attributes; l != NULL; l = l->next) {
+		attr = (PopplerTextAttributes *) l->data;
+		a.start = attr->start_index;
+		a.end = attr->end_index;
+		a.size = attr->font_size;
+		a.red = attr->color.red;
+		a.green = attr->color.green;
+		a.blue = attr->color.blue;
+		a.underlined = attr->is_underlined;
+		fwrite(&a, sizeof(a), 1, fd);
+		a.font += strlen(attr->font_name == NULL ?
+			"" : attr->font_name) + 1;
+	}
+	for (i = 0; i < pt->nareas; i++) {
+		memset(&c, 0, sizeof(c));
+		c.kind = pt->area[i].kind;
+		c.num = pt->area[i].rl->num;
+		c.distance = pt->area[i].distance;
+		fwrite(&c, sizeof(c), 1, fd);
+		fwrite(pt->area[i].rl->rect, sizeof(PopplerRectangle),
+			pt->area[i].rl->num, fd);
+	}
+	fwrite(text, 1, h.textlen + 1, fd);
+	for (l = attributes; l != NULL; l = l->next) {
+		attr = (PopplerTextAttributes *) l->data;
+		font = attr->font_name == NULL ? "" : attr->font_name;
+		fwrite(font, 1, strlen(font) + 1, fd);
+	}
+
+	ok = ! ferror(fd);
+	written = ftell(fd);
+	if (fclose(fd) != 0 || ! ok || rename(tmp, pt->cachefile) == -1)
+		unlink(tmp);
+	else
+		pagecachewritten += written;
+	g_free(tmp);
+
+	if (pagecachewritten > pagecache_limit() / 8)
+		pagecache_evict(pagecache_directory());
+}
+
+/*
+ * a textarea of the page from the cache, or NULL
+ */
+RectangleList *pagecache_area(PageText *pt, gint kind, gdouble distance) {
+	gint i;
+
+	if (pt->zone != NULL)
+		return NULL;
+	for (i = 0; i < pt->nareas; i++)
+		if (pt->area[i].kind == kind &&
+		    pt->area[i].distance == distance)
+			return rectanglelist_copy(pt->area[i].rl);
+	return NULL;
+}
+
+/*
+ * store a textarea of the page in the cache, dropping the oldest if full
+ */
+void pagecache_addarea(PageText *pt, gint kind, gdouble distance,
+		RectangleList *rl) {
+	if (pt->cachefile == NULL || pt->zone != NULL)
+		return;
+	if (pt->nareas >= PAGECACHE_AREAS) {
+		rectanglelist_free(pt->area[0].rl);
+		memmove(&pt->area[0], &pt->area[1],
+			(PAGECACHE_AREAS - 1) * sizeof(pt->area[0]));
+		pt->nareas--;
 	}
-
-	return TRUE;
+	pt->area[pt->nareas].kind = kind;
+	pt->area[pt->nareas].distance = distance;
+	pt->area[pt->nareas].rl = rectanglelist_copy(rl);
+	pt->nareas++;
+	pt->dirty = TRUE;
 }
 
 /*
- * subtract a rectangle list from a single rectangle: res = r - rl
+ * the text of a page, fetched when requested
  */
-RectangleList *rectanglelist_subtract1(PopplerRectangle *r, RectangleList *rl,
-		PopplerRectangle *cont, RectangleBound *b) {
-	RectangleList *res;
+PageText *pagetext_new(PopplerPage *page) {
+	PageText *pt;
+	gint64 timing;
+
+	pt = malloc(sizeof(PageText));
+	pt->page = g_object_ref(page);
+	rectangle_page(page, &pt->bounds);
+	pt->text = NULL;
+	pt->rect = NULL;
+	pt->num = 0;
+	pt->layout = FALSE;
+	pt->attributes = NULL;
+	pt->attributed = FALSE;
+	pt->zone = NULL;
+
+	pt->cachefile = NULL;
+	pt->map = NULL;
+	pt->mapsize = 0;
+	pt->nareas = 0;
+	pt->dirty = FALSE;
+	if (pagecachekey[0] != '\0') {
+		timing = pagetiming_now();
+		pt->cachefile = g_strdup_printf("%s/%s-%d",
+			pagecache_directory(), pagecachekey,
+			poppler_page_get_index(page));
+		pt->dirty = ! pagecache_load(pt);
+		pagetiming_stage(STAGE_EXTRACT, timing, pt->num);
+	}
+	return pt;
+}
 
-	res = rectanglelist_new(MAXRECT);
-	rectangle_copy(res->rect, r);
-	res->num = 1;
+char *pagetext_text(PageText *pt) {
+	gint64 timing;
 
-	if (! rectanglelist_subtract(&res, rl, cont, b)) {
-		rectanglelist_free(res);
-		return NULL;
+	if (pt->text == NULL && pt->page != NULL) {
+		timing = pagetiming_now();
+		pt->text = poppler_page_get_text(pt->page);
+		pagetiming_stage(STAGE_EXTRACT, timing, 0);
 	}
-	return res;
+	return pt->text;
+}
+
+PopplerRectangle *pagetext_layout(PageText *pt, guint *num) {
+	gint64 timing;
+
+	if (! pt->layout && pt->page != NULL) {
+		timing = pagetiming_now();
+		if (! poppler_page_get_text_layout(pt->page,
+				&pt->rect, &pt->num))
+			pt->num = 0;
+		pt->layout = TRUE;
+		pagetiming_stage(STAGE_EXTRACT, timing, pt->num);
+	}
+	*num = pt->num;
+	return pt->rect;
+}
+
+GList *pagetext_attributes(PageText *pt) {
+	gint64 timing;
+
+	if (! pt->attributed && pt->page != NULL) {
+		timing = pagetiming_now();
+		pt->attributes = poppler_page_get_text_attributes(pt->page);
+		pt->attributed = TRUE;
+		pt->dirty = pt->cachefile != NULL;
+		pagetiming_stage(STAGE_EXTRACT, timing, 0);
+	}
+	return pt->attributes;
 }
 
 /*
- * join consecutive touching rectangles of a list
+ * restrict the analysis of the text to a zone of the page (NULL = none): the
+ * characters not in it are ignored, the textareas are searched within it and
+ * not cached, since they depend on the zone
  */
-void rectanglelist_consecutive(RectangleList *orig) {
-	gint i, j;
-
-	if (orig->num == 0)
-		return;
+void pagetext_zone(PageText *pt, PopplerRectangle *zone) {
+	if (pt->zone != NULL)
+		poppler_rectangle_free(pt->zone);
+	pt->zone = zone == NULL ? NULL : poppler_rectangle_copy(zone);
+}
 
-	for (j = 0, i = 1; i < orig->num; i++)
-		if (rectangle_touch(orig->rect + j, orig->rect + i))
-			rectangle_join(orig->rect + j, orig->rect + i);
-		else {
-			j++;
-			rectangle_copy(orig->rect + j, orig->rect + i);
-		}
-	orig->num = j + 1;
+/*
+ * the area where the text is analyzed: the page, or its part in the zone
+ */
+void pagetext_area(PageText *pt, PopplerRectangle *area) {
+	if (pt->zone == NULL || ! rectangle_overlap(pt->zone, &pt->bounds))
+		*area = pt->bounds;
+	else
+		rectangle_intersect(area, pt->zone, &pt->bounds);
 }
 
 /*
- * join touching rectangles in a rectangle list
+ * drop the reference to the page: what is not fetched yet is no longer
+ * fetched, as if the page had no text
  */
-void rectanglelist_join(RectangleList *orig) {
-	gint i, j, n;
+void pagetext_release(PageText *pt) {
+	if (pt == NULL || pt->page == NULL)
+		return;
+	g_object_unref(pt->page);
+	pt->page = NULL;
+}
 
-	/* why the do-while loop: joining may produce a rectangle that overlaps
-	 * a previous one, for example:
-	 *	1 2
-	 *	  3
-	 *	654
-	 * rectangle 1 does not touch any else; but then 2 is joined to 3, then
-	 * 4, 5 and 6; the resulting rectangle includes 1, since joining two
-	 * rectangles produces a rectangle that includes both */
+void pagetext_free(PageText *pt) {
+	gint i;
 
-	do {
-		n = orig->num;
-		for (i = 0; i < orig->num; i++)
-			for (j = i + 1; j < orig->num; j++)
-				if (rectangle_touch(orig->rect + i,
-						orig->rect + j)) {
-					rectangle_join(orig->rect + i,
-						orig->rect + j);
-					rectanglelist_delete(orig, j);
-					j = i;
-				}
-	} while (n != orig->num);
+	if (pt == NULL)
+		return;
+	if (pt->cachefile != NULL && pt->dirty)
+		pagecache_save(pt);
+	if (pt->map != NULL)
+		munmap(pt->map, pt->mapsize);
+	else {
+		g_free(pt->text);
+		g_free(pt->rect);
+	}
+	if (pt->attributes != NULL)
+		poppler_page_free_text_attributes(pt->attributes);
+	for (i = 0; i < pt->nareas; i++)
+		rectanglelist_free(pt->area[i].rl);
+	g_free(pt->cachefile);
+	if (pt->zone != NULL)
+		poppler_rectangle_free(pt->zone);
+	pagetext_release(pt);
+	free(pt);
 }
 
 /*
  * the rectangles of the single characters in the page
  */
-RectangleList *rectanglelist_characters(PopplerPage *page) {
+RectangleList *rectanglelist_characters_pagetext(PageText *pt) {
 	RectangleList *layout;
+	PopplerRectangle *rect;
 	char *text, *cur, *next;
 	guint n;
 	gint r;
 
-	layout = rectanglelist_new(0);
-	poppler_page_get_text_layout(page, &layout->rect, &n);
+	rect = pagetext_layout(pt, &n);
+	layout = rectanglelist_new(n);
+	if (n > 0)
+		memcpy(layout->rect, rect, n * sizeof(PopplerRectangle));
 	layout->num = n;
-	layout->max = n; // poppler_page_get_text_layout allocated layout->rect
-	text = poppler_page_get_text(page);
+	text = pagetext_text(pt);
 
 	/* nullify rectangles of white spaces ' '; yes, it happens */
 	for (r = 0, cur = text; r < layout->num; r++, cur = next) {
@@ -1008,21 +2886,38 @@ RectangleList *rectanglelist_characters(PopplerPage *page) {
 			layout->rect[r].x2 = layout->rect[r].x1;
 	}
 
-	free(text);
+	/* only the characters in the zone */
+	if (pt->zone != NULL) {
+		for (r = 0, layout->num = 0; r < (gint) n; r++)
+			if (rectangle_contain(pt->zone, &rect[r]))
+				layout->rect[layout->num++] = layout->rect[r];
+	}
+
+	return layout;
+}
+
+RectangleList *rectanglelist_characters(PopplerPage *page) {
+	PageText *pt;
+	RectangleList *layout;
+
+	pt = pagetext_new(page);
+	layout = rectanglelist_characters_pagetext(pt);
+	pagetext_free(pt);
 	return layout;
 }
 
 /*
- * the area used by text in the page
+ * the area used by text in an area of the page, usually the whole page
  * the gdouble parameters define the minimal size of considered rectangles
  */
-RectangleList *rectanglelist_textarea_bound(PopplerPage *page,
+RectangleList *rectanglelist_textarea_bound(PopplerRectangle *area,
 		RectangleList *layout,
 		gdouble whiteboth, gdouble whiteeach,
 		gdouble blackboth, gdouble blackeach) {
 	PopplerRectangle p;
 	RectangleList *white, *black;
 	RectangleBound wb, bb;
+	gint64 timing;
 
 	wb.both = whiteboth;
 	wb.each = whiteeach;
@@ -1034,37 +2929,49 @@ RectangleList *rectanglelist_textarea_bound(PopplerPage *page,
 	if (debugtextrectangles == 1)
 		return layout;
 
+	timing = pagetiming_now();
 	rectanglelist_consecutive(layout);
+	pagetiming_stage(STAGE_CONSECUTIVE, timing, layout->num);
 	if (debugtextrectangles)
 		printf("consecutive rectangles: %d\n", layout->num);
 	if (debugtextrectangles == 2)
 		return layout;
 
-	rectangle_page(page, &p);
+	p = *area;
 	p.x1 -= wb.both - 1.0;	/* enlarge, otherwise thin white areas at */
 	p.y1 -= wb.both - 1.0;  /* the borders are lost */
 	p.x2 += wb.both + 1.0;
 	p.y2 += wb.both + 1.0;
+	timing = pagetiming_now();
 	white = rectanglelist_subtract1(&p, layout, NULL, &wb);
-	if (white == NULL)
+	if (white == NULL) {
+		rectanglelist_free(layout);
 		return NULL;
+	}
+	pagetiming_stage(STAGE_WHITE, timing, white->num);
 	if (debugtextrectangles)
 		printf("white rectangles: %d\n", white->num);
 	rectanglelist_free(layout);
 	if (debugtextrectangles == 3)
 		return white;
 
-	rectangle_page(page, &p);
+	p = *area;
+	timing = pagetiming_now();
 	black = rectanglelist_subtract1(&p, white, NULL, &bb);
-	if (black == NULL)
+	if (black == NULL) {
+		rectanglelist_free(white);
 		return NULL;
+	}
+	pagetiming_stage(STAGE_BLACK, timing, black->num);
 	if (debugtextrectangles)
 		printf("white rectangles: %d\n", black->num);
 	rectanglelist_free(white);
 	if (debugtextrectangles == 4)
 		return black;
 
+	timing = pagetiming_now();
 	rectanglelist_join(black);
+	pagetiming_stage(STAGE_JOIN, timing, black->num);
 	if (debugtextrectangles)
 		printf("joined rectangles: %d\n", black->num);
 
@@ -1073,36 +2980,376 @@ RectangleList *rectanglelist_textarea_bound(PopplerPage *page,
 }
 
 /*
- * the area used by text in the page, with fallback to whole page
+ * the area used by text in an area of the page, with fallback to the area
  */
-RectangleList *rectanglelist_textarea_bound_fallback(PopplerPage *page,
+RectangleList *rectanglelist_textarea_bound_fallback(PopplerRectangle *area,
 		RectangleList *layout,
 		gdouble whiteboth, gdouble whiteeach,
 		gdouble blackboth, gdouble blackeach) {
 	RectangleList *res;
-	res = rectanglelist_textarea_bound(page, layout,
+	res = rectanglelist_textarea_bound(area, layout,
 			whiteboth, whiteeach, blackboth, blackeach);
 	if (res != NULL)
 		return res;
 
 	/* fallback: finding the rectangle list was impossible because of the
-	 * large number of rectangles; just return the whole page */
+	 * large number of rectangles; just return the whole area */
 	res = rectanglelist_new(1);
-	rectangle_page(page, res->rect);
+	rectangle_copy(res->rect, area);
 	res->num = 1; // res is created with max=1
 	return res;
 }
 
+/*
+ * maximal number of cells of the raster on each side of the page
+ */
+#define RASTERMAX 512
+
+/*
+ * dilation or erosion of a line of n cells, step apart, by k cells
+ */
+void rectangleraster_line(guchar *line, gint n, gint step, gint k,
+		gboolean erode, gint *sum) {
+	gint i, a, b;
+
+	sum[0] = 0;
+	for (i = 0; i < n; i++)
+		sum[i + 1] = sum[i] + line[i * step];
+	for (i = 0; i < n; i++) {
+		a = MAX(i - k, 0);
+		b = MIN(i + k + 1, n);
+		line[i * step] = erode ?
+			i - k >= 0 && i + k < n && sum[b] - sum[a] == 2 * k + 1 :
+			sum[b] - sum[a] > 0;
+	}
+}
+
+/*
+ * area of text in an area of the page, by a raster of the characters
+ */
+RectangleList *rectanglelist_textarea_raster(PopplerRectangle *area,
+		RectangleList *layout, gdouble distance) {
+	PopplerRectangle p, r;
+	RectangleList *res;
+	gdouble cell;
+	gint w, h, cols, rows, pad, x, y, x1, y1, x2, y2, i, c, n;
+	guchar *grid;
+	gint *sum, *label, *stack, nstack, *component;
+	gboolean *found;
+
+	if (debugtextrectangles)
+		printf("character rectangles: %d\n", layout->num);
+
+	p = *area;
+	cell = MAX(rectangle_width(&p), rectangle_height(&p)) / RASTERMAX;
+	cell = MAX(cell, distance / 4);
+	pad = (gint) (distance / 2 / cell + 0.5);
+	w = (gint) (rectangle_width(&p) / cell) + 1;
+	h = (gint) (rectangle_height(&p) / cell) + 1;
+	cols = w + 2 * pad;
+	rows = h + 2 * pad;
+	if (debugtextrectangles)
+		printf("raster: %dx%d\n", cols, rows);
+
+				/* mark the cells of the characters */
+
+	grid = calloc(cols * rows, sizeof(guchar));
+	component = malloc(MAX(layout->num, 1) * sizeof(gint));
+	for (i = 0; i < layout->num; i++) {
+		rectangle_copy(&r, &layout->rect[i]);
+		rectangle_normalize(&r);
+		x1 = CLAMP((gint) ((r.x1 - p.x1) / cell), 0, w - 1);
+		y1 = CLAMP((gint) ((r.y1 - p.y1) / cell), 0, h - 1);
+		x2 = CLAMP((gint) ((r.x2 - p.x1) / cell), 0, w - 1);
+		y2 = CLAMP((gint) ((r.y2 - p.y1) / cell), 0, h - 1);
+		for (y = y1; y <= y2; y++)
+			for (x = x1; x <= x2; x++)
+				grid[(y + pad) * cols + x + pad] = 1;
+		component[i] = (y1 + pad) * cols + x1 + pad;
+	}
+
+				/* close: dilate, then erode */
+
+	sum = malloc((MAX(cols, rows) + 1) * sizeof(gint));
+	for (y = 0; y < rows; y++)
+		rectangleraster_line(grid + y * cols, cols, 1, pad, FALSE, sum);
+	for (x = 0; x < cols; x++)
+		rectangleraster_line(grid + x, rows, cols, pad, FALSE, sum);
+	for (y = 0; y < rows; y++)
+		rectangleraster_line(grid + y * cols, cols, 1, pad, TRUE, sum);
+	for (x = 0; x < cols; x++)
+		rectangleraster_line(grid + x, rows, cols, pad, TRUE, sum);
+	free(sum);
+
+				/* connected sets of cells */
+
+	label = malloc(cols * rows * sizeof(gint));
+	stack = malloc(cols * rows * sizeof(gint));
+	for (i = 0; i < cols * rows; i++)
+		label[i] = -1;
+	for (i = 0, n = 0; i < cols * rows; i++) {
+		if (! grid[i] || label[i] != -1)
+			continue;
+		label[i] = n;
+		stack[0] = i;
+		nstack = 1;
+		while (nstack > 0) {
+			c = stack[--nstack];
+			x = c % cols;
+			y = c / cols;
+#define RASTERVISIT(cond, d)					\
+			if ((cond) && grid[c + (d)] &&		\
+			    label[c + (d)] == -1) {		\
+				label[c + (d)] = n;		\
+				stack[nstack++] = c + (d);	\
+			}
+			RASTERVISIT(x > 0, -1);
+			RASTERVISIT(x < cols - 1, 1);
+			RASTERVISIT(y > 0, -cols);
+			RASTERVISIT(y < rows - 1, cols);
+#undef RASTERVISIT
+		}
+		n++;
+	}
+	free(stack);
+	free(grid);
+
+				/* rectangle of the characters of each set */
+
+	res = rectanglelist_new(MAX(n, 1));
+	res->num = n;
+	found = calloc(MAX(n, 1), sizeof(gboolean));
+	for (i = 0; i < layout->num; i++) {
+		c = label[component[i]];
+		rectangle_copy(&r, &layout->rect[i]);
+		rectangle_normalize(&r);
+		if (found[c])
+			rectangle_join(&res->rect[c], &r);
+		else
+			rectangle_copy(&res->rect[c], &r);
+		found[c] = TRUE;
+	}
+	for (c = 0, i = 0; c < n; c++)
+		if (found[c])
+			rectangle_copy(&res->rect[i++], &res->rect[c]);
+	res->num = i;
+	free(found);
+	free(label);
+	free(component);
+	rectanglelist_free(layout);
+	if (debugtextrectangles)
+		printf("raster rectangles: %d\n", res->num);
+
+	rectanglelist_join(res);
+	if (debugtextrectangles)
+		printf("joined rectangles: %d\n", res->num);
+
+	rectanglelist_tighten(res);
+	return res;
+}
+
+/*
+ * compare two pairs of rectangles by distance
+ */
+int rectanglepair_compare(const void *a, const void *b) {
+	gdouble da = ((RectanglePair *) a)->distance;
+	gdouble db = ((RectanglePair *) b)->distance;
+	return da < db ? -1 : da == db ? 0 : 1;
+}
+
+/*
+ * build the hierarchy of the blocks of text of a page up to a distance
+ */
+RectangleHierarchy *rectanglehierarchy_new_pagetext(PageText *pt,
+		gdouble maxdistance) {
+	RectangleHierarchy *h;
+	RectangleList *blocks;
+	PopplerRectangle e;
+	RectanglePair *pair;
+	gint npair, maxpair, *parent, i, k;
+	gdouble d;
+	gint64 timing;
+
+	blocks = rectanglelist_characters_pagetext(pt);
+	timing = pagetiming_now();
+	h = malloc(sizeof(RectangleHierarchy));
+	h->distance = blocks->num == 0 ? 0 :
+		MIN(15, MAX(9, 1.5 * rectanglelist_averagewidth(blocks)));
+	h->maxdistance = maxdistance;
+	rectanglelist_consecutive(blocks);
+	for (i = 0; i < blocks->num; i++)
+		rectangle_normalize(&blocks->rect[i]);
+	rectanglelist_unindex(blocks);
+	h->blocks = blocks;
+
+				/* pairs of blocks closer than maxdistance */
+
+	maxpair = MAX(blocks->num, 1);
+	pair = malloc(maxpair * sizeof(RectanglePair));
+	npair = 0;
+	for (i = 0; i < blocks->num; i++) {
+		rectangle_copy(&e, &blocks->rect[i]);
+		rectangle_expand(&e, maxdistance, maxdistance);
+		for (k = rectanglelist_find(blocks, &e, i + 1, rectangle_touch);
+		     k != -1;
+		     k = rectanglelist_find(blocks, &e, k + 1, rectangle_touch)) {
+			d = MAX(rectangle_hdistance(&blocks->rect[i],
+			                            &blocks->rect[k]),
+			        rectangle_vdistance(&blocks->rect[i],
+			                            &blocks->rect[k]));
+			if (d >= maxdistance)
+				continue;
+			if (npair >= maxpair) {
+				maxpair *= 2;
+				pair = realloc(pair,
+					maxpair * sizeof(RectanglePair));
+			}
+			pair[npair].distance = d;
+			pair[npair].a = i;
+			pair[npair].b = k;
+			npair++;
+		}
+	}
+	qsort(pair, npair, sizeof(RectanglePair), rectanglepair_compare);
+
+				/* the pairs that join different sets */
+
+	h->join = malloc(MAX(blocks->num, 1) * sizeof(RectanglePair));
+	h->num = 0;
+	parent = malloc(MAX(blocks->num, 1) * sizeof(gint));
+	for (i = 0; i < blocks->num; i++)
+		parent[i] = i;
+	for (i = 0; i < npair; i++)
+		if (unionfind_union(parent, pair[i].a, pair[i].b)) {
+			h->join[h->num].distance = pair[i].distance;
+			h->join[h->num].a = pair[i].a;
+			h->join[h->num].b = pair[i].b;
+			h->num++;
+		}
+	free(parent);
+	free(pair);
+
+	pagetiming_stage(STAGE_HIERARCHY, timing, h->num);
+	return h;
+}
+
+RectangleHierarchy *rectanglehierarchy_new(PopplerPage *page,
+		gdouble maxdistance) {
+	PageText *pt;
+	RectangleHierarchy *h;
+
+	pt = pagetext_new(page);
+	h = rectanglehierarchy_new_pagetext(pt, maxdistance);
+	pagetext_free(pt);
+	return h;
+}
+
+/*
+ * the blocks of text of a hierarchy for a distance (-1 = default)
+ */
+RectangleList *rectanglehierarchy_cut(RectangleHierarchy *h,
+		gdouble distance) {
+	RectangleList *res;
+	gint *parent, *position, i, j, root;
+
+	if (distance == -1)
+		distance = h->distance;
+	distance = MIN(distance, h->maxdistance);
+
+	parent = malloc(MAX(h->blocks->num, 1) * sizeof(gint));
+	for (i = 0; i < h->blocks->num; i++)
+		parent[i] = i;
+	for (j = 0; j < h->num && h->join[j].distance < distance; j++)
+		unionfind_union(parent, h->join[j].a, h->join[j].b);
+
+	res = rectanglelist_new(MAX(h->blocks->num, 1));
+	position = malloc(MAX(h->blocks->num, 1) * sizeof(gint));
+	for (i = 0; i < h->blocks->num; i++) {
+		root = unionfind_root(parent, i);
+		if (root == i) {
+			position[i] = res->num;
+			rectangle_copy(&res->rect[res->num++],
+				&h->blocks->rect[i]);
+		}
+		else
+			rectangle_join(&res->rect[position[root]],
+				&h->blocks->rect[i]);
+	}
+	free(position);
+	free(parent);
+
+	rectanglelist_join(res);
+	rectanglelist_tighten(res);
+	return res;
+}
+
+/*
+ * free a hierarchy
+ */
+void rectanglehierarchy_free(RectangleHierarchy *h) {
+	if (h == NULL)
+		return;
+	rectanglelist_free(h->blocks);
+	free(h->join);
+	free(h);
+}
+
 /*
  * text area in the page, with parametric minimal distance considered a space
  */
+RectangleList *rectanglelist_textarea_distance_pagetext(PageText *pt,
+		gdouble w) {
+	RectangleList *layout, *textarea;
+	RectangleHierarchy *h;
+	PopplerRectangle area;
+	gint kind;
+	gdouble d;
+	gint64 timing;
+
+	/* with debugtextrectangles, the result may be an intermediate list:
+	 * neither read nor store it in the cache */
+	kind = textareamethod;
+	textarea = debugtextrectangles != 0 ? NULL :
+		pagecache_area(pt, kind, w);
+	if (textarea != NULL)
+		return textarea;
+
+	if (textareamethod == 2) {
+		h = rectanglehierarchy_new_pagetext(pt, w == -1 ? 15 : w);
+		timing = pagetiming_now();
+		textarea = rectanglehierarchy_cut(h, w);
+		pagetiming_stage(STAGE_HIERARCHY, timing, textarea->num);
+		rectanglehierarchy_free(h);
+	}
+	else {
+		layout = rectanglelist_characters_pagetext(pt);
+		d = w != -1 ? w :
+			MIN(15, MAX(9, 1.5 * rectanglelist_averagewidth(layout)));
+		pagetext_area(pt, &area);
+		if (textareamethod == 1) {
+			timing = pagetiming_now();
+			textarea = rectanglelist_textarea_raster(&area,
+				layout, d);
+			pagetiming_stage(STAGE_RASTER, timing, textarea->num);
+		}
+		else
+			textarea = rectanglelist_textarea_bound_fallback(
+				&area, layout, d, 100.0, 0.0, 0.0);
+	}
+
+	if (debugtextrectangles == 0)
+		pagecache_addarea(pt, kind, w, textarea);
+	return textarea;
+}
+
 RectangleList *rectanglelist_textarea_distance(PopplerPage *page, gdouble w) {
-	RectangleList *layout;
-	layout = rectanglelist_characters(page);
-	if (w == -1)
-		w = MIN(15, MAX(9, 1.5 * rectanglelist_averagewidth(layout)));
-	return rectanglelist_textarea_bound_fallback(page, layout,
-			w, 100.0, 0.0, 0.0);
+	PageText *pt;
+	RectangleList *textarea;
+
+	pt = pagetext_new(page);
+	textarea = rectanglelist_textarea_distance_pagetext(pt, w);
+	pagetext_free(pt);
+	return textarea;
 }
 
 /*
@@ -1128,21 +3375,29 @@ PopplerRectangle *rectanglelist_pagelargest(PopplerPage *page) {
 /*
  * bounding box of a page (NULL if no text is in the page)
  */
+PopplerRectangle *rectanglelist_boundingbox_pagetext(PageText *pt) {
+	PopplerRectangle *box, *rect;
+	guint n, i;
+
+	rect = pagetext_layout(pt, &n);
+	box = NULL;
+	for (i = 0; i < n; i++)
+		if (pt->zone != NULL && ! rectangle_contain(pt->zone, &rect[i]))
+			continue;
+		else if (box == NULL)
+			box = poppler_rectangle_copy(&rect[i]);
+		else
+			rectangle_join(box, &rect[i]);
+	return box;
+}
+
 PopplerRectangle *rectanglelist_boundingbox(PopplerPage *page) {
-	RectangleList *all;
+	PageText *pt;
 	PopplerRectangle *box;
-	guint n;
-
-	all = rectanglelist_new(0);
-	poppler_page_get_text_layout(page, &all->rect, &n);
-	if (n == 0)
-		return NULL;
-	all->num = n;
-	all->max = n; // poppler_page_get_text_layout allocated all->rect
-
-	box = rectanglelist_joinall(all);
 
-	rectanglelist_free(all);
+	pt = pagetext_new(page);
+	box = rectanglelist_boundingbox_pagetext(pt);
+	pagetext_free(pt);
 	return box;
 }
 
@@ -1191,17 +3446,45 @@ PopplerRectangle *rectanglelist_boundingbox_document(PopplerDocument *doc) {
 	return rectanglelist_box_document(doc, 1);
 }
 
+/*
+ * position of the first byte from x on in a row of w bytes that is nonzero or
+ * zero; blocks of eight bytes are checked at once, either by comparing them
+ * with zero or by the usual bit trick for finding a zero byte in a word
+ */
+int rectanglelist_paintedscan(unsigned char *row, int x, int w,
+		gboolean nonzero) {
+	guint64 block;
+
+	for (; x + 8 <= w; x += 8) {
+		memcpy(&block, row + x, 8);
+		if (nonzero ?
+			block != 0 :
+			((block - 0x0101010101010101ULL) & ~block &
+			 0x8080808080808080ULL) != 0)
+			break;
+	}
+	for (; x < w; x++)
+		if ((row[x] != 0) == nonzero)
+			break;
+	return x;
+}
+
 /*
  * list of squares of a grid that are painted in a page
+ *
+ * the painted squares in a row are joined in horizontal runs; a run is merged
+ * with the rectangle of the same horizontal extent in the previous row if
+ * any; open[] holds the rectangles ending at the previous row, sorted by x1
  */
 RectangleList *rectanglelist_painted(PopplerPage *page, int distance) {
 	double width, height;
 	cairo_surface_t *surface;
 	cairo_t *cr;
-	unsigned char *data;
-	int w, h, stride, x, y;
+	unsigned char *data, *row;
+	int w, h, stride, x, y, e, j;
+	int *open, nopen, *next, nnext, *swap;
 	RectangleList *painted;
-	PopplerRectangle *r;
+	PopplerRectangle r;
 
 	poppler_page_get_size(page, &width, &height);
 	w = width / distance;
@@ -1213,24 +3496,49 @@ RectangleList *rectanglelist_painted(PopplerPage *page, int distance) {
 	poppler_page_render_for_printing(page, cr);
 	cairo_surface_show_page(surface);
 
+	cairo_surface_flush(surface);
 	data = cairo_image_surface_get_data(surface);
 	stride = cairo_image_surface_get_stride(surface);
-	cairo_surface_flush(surface);
 
 	painted = rectanglelist_new(MAXRECT);
-
-	for (y = 0; y < h; y++)
-		for (x = 0; x < w; x++) {
-			if (data[stride * y + x ] == 0)
-				continue;
-			r = poppler_rectangle_new();
-			r->x1 = x * distance;
-			r->y1 = y * distance;
-			r->x2 = r->x1 + distance;
-			r->y2 = r->y1 + distance;
-			rectanglelist_append(painted, r);
+	open = malloc((w + 1) * sizeof(int));
+	next = malloc((w + 1) * sizeof(int));
+	nopen = 0;
+
+	for (y = 0; y < h; y++) {
+		row = data + stride * y;
+		nnext = 0;
+		j = 0;
+		for (x = rectanglelist_paintedscan(row, 0, w, TRUE);
+		     x < w;
+		     x = rectanglelist_paintedscan(row, e, w, TRUE)) {
+			e = rectanglelist_paintedscan(row, x, w, FALSE);
+			r.x1 = x * distance;
+			r.y1 = y * distance;
+			r.x2 = e * distance;
+			r.y2 = r.y1 + distance;
+
+			while (j < nopen && painted->rect[open[j]].x1 < r.x1)
+				j++;
+			if (j < nopen &&
+			    painted->rect[open[j]].x1 == r.x1 &&
+			    painted->rect[open[j]].x2 == r.x2) {
+				painted->rect[open[j]].y2 = r.y2;
+				next[nnext++] = open[j];
+			}
+			else {
+				rectanglelist_append(painted, &r);
+				next[nnext++] = painted->num - 1;
+			}
 		}
+		swap = open;
+		open = next;
+		next = swap;
+		nopen = nnext;
+	}
 
+	free(open);
+	free(next);
 	cairo_destroy(cr);
 	cairo_surface_destroy(surface);
 
@@ -1243,10 +3551,12 @@ RectangleList *rectanglelist_painted(PopplerPage *page, int distance) {
 RectangleList *rectanglelist_paintedarea_distance(PopplerPage *page,
 		gdouble w) {
 	RectangleList *layout;
+	PopplerRectangle p;
 	if (w == -1)
 		w = 15.0;
 	layout = rectanglelist_painted(page, w);
-	return rectanglelist_textarea_bound(page, layout, w, 100.0, 0.0, 0.0);
+	rectangle_page(page, &p);
+	return rectanglelist_textarea_bound(&p, layout, w, 100.0, 0.0, 0.0);
 }
 
 /*
@@ -1266,12 +3576,18 @@ PopplerRectangle *rectanglelist_boundingbox_painted(PopplerPage *page,
 /*
  * list of rows in a page
  */
-RectangleList *rectanglelist_rows(PopplerPage *page, gdouble distance) {
+RectangleList *rectanglelist_rows_pagetext(PageText *pt, gdouble distance) {
 	RectangleList *layout, *rows;
 	PopplerRectangle *r;
 	int i, j;
+	gint64 timing;
+
+	rows = pagecache_area(pt, PAGECACHE_ROWS, distance);
+	if (rows != NULL)
+		return rows;
 
-	layout = rectanglelist_characters(page);
+	layout = rectanglelist_characters_pagetext(pt);
+	timing = pagetiming_now();
 	qsort(layout->rect, layout->num, sizeof(PopplerRectangle),
 		(int (*)(const void *, const void *)) rectangle_vcompare);
 
@@ -1286,7 +3602,19 @@ RectangleList *rectanglelist_rows(PopplerPage *page, gdouble distance) {
 			rectanglelist_append(rows, r);
 	}
 
-	free(layout);
+	rectanglelist_free(layout);
+	pagetiming_stage(STAGE_ROWS, timing, rows->num);
+	pagecache_addarea(pt, PAGECACHE_ROWS, distance, rows);
+	return rows;
+}
+
+RectangleList *rectanglelist_rows(PopplerPage *page, gdouble distance) {
+	PageText *pt;
+	RectangleList *rows;
+
+	pt = pagetext_new(page);
+	rows = rectanglelist_rows_pagetext(pt, distance);
+	pagetext_free(pt);
 	return rows;
 }
 
@@ -1422,66 +3750,62 @@ void rectanglevector_add(RectangleVector *v, PopplerRectangle *r) {
 }
 
 /*
- * rectangles often taken by short blocks of text
+ * percentage of the pages of a document sampled for frequent rectangles
  */
-RectangleList *rectanglevector_frequent(PopplerDocument *doc,
-		gdouble height, gdouble distance) {
-	PopplerPage *page;
-	int npages, n, iterations, samplerate, r;
-	PopplerRectangle *rect;
-	RectangleList *textarea = NULL, *result;
-	RectangleVector *frequent;
+int rectanglevector_samplerate(int npages) {
+	return npages < 40 ? 100 : npages < 100 ? 50 : 25;
+}
 
-	frequent = rectanglevector_create(30);
+/*
+ * add the short blocks of the textarea of page n to the frequent rectangles
+ */
+void rectanglevector_frequent_add(RectangleVector *frequent,
+		RectangleList *textarea, gdouble height, int n) {
+	PopplerRectangle *rect;
+	int r;
 
-	npages = poppler_document_get_n_pages(doc);
-	samplerate = npages < 40 ? 100 : npages < 100 ? 50 : 25;
-	srandom(time(NULL));
 	if (height == -1)
 		height = 20;
 
-	if (debugfrequent & (0x01 | 0x02))
-		printf("iterations:\n");
-	iterations = 0;
-	for (n = 0; n < npages; n++) {
-		if (random() % 100 > samplerate)
-			continue;
-		iterations++;
-		page = poppler_document_get_page(doc, n);
-		textarea = rectanglelist_textarea_distance(page, distance);
-		if (debugfrequent) {
-			printf("  - page: %d\n", n);
-			printf("    textarea: %d\n", textarea->num);
-		}
+	if (debugfrequent) {
+		printf("  - page: %d\n", n);
+		printf("    textarea: %d\n", textarea->num);
+	}
 
-		if (debugfrequent & 0x01) {
-			printf("    textarea:\n");
-			rectanglelist_printyaml(stdout,
-				"      - ", "        ", textarea);
-		}
+	if (debugfrequent & 0x01) {
+		printf("    textarea:\n");
+		rectanglelist_printyaml(stdout,
+			"      - ", "        ", textarea);
+	}
 
-		for (r = 0; r < textarea->num; r++)
-			if (rectangle_height(&textarea->rect[r]) <= height) {
-				rect = &textarea->rect[r];
-				rectanglevector_add(frequent, rect);
-				if (debugfrequent & 0x02) {
-					printf("      -> ");
-					rectangle_print(stdout, rect);
-					printf("\n");
-					rectanglevector_print(stdout, frequent);
-					printf("\n");
-				}
+	for (r = 0; r < textarea->num; r++)
+		if (rectangle_height(&textarea->rect[r]) <= height) {
+			rect = &textarea->rect[r];
+			rectanglevector_add(frequent, rect);
+			if (debugfrequent & 0x02) {
+				printf("      -> ");
+				rectangle_print(stdout, rect);
+				printf("\n");
+				rectanglevector_print(stdout, frequent);
+				printf("\n");
 			}
-
-		if (debugfrequent & 0x01) {
-			printf("    frequent:\n");
-			rectanglevector_printyaml(stdout,
-				"      - ", "        ", frequent);
 		}
 
-		rectanglelist_free(textarea);
-		g_object_unref(page);
+	if (debugfrequent & 0x01) {
+		printf("    frequent:\n");
+		rectanglevector_printyaml(stdout,
+			"      - ", "        ", frequent);
 	}
+}
+
+/*
+ * the rectangles of a frequency vector that are frequent enough over a number
+ * of pages; the vector is freed
+ */
+RectangleList *rectanglevector_frequent_list(RectangleVector *frequent,
+		int iterations) {
+	RectangleList *result;
+	int r;
 
 	for (r = 0;
 	     r < frequent->num && frequent->rect[r].rank > iterations / 6;
@@ -1502,6 +3826,69 @@ RectangleList *rectanglevector_frequent(PopplerDocument *doc,
 	return result;
 }
 
+/*
+ * the document where to sample pages: with a memory ceiling and the uri of
+ * the document, a copy of it, which can be reopened by memory_recycle()
+ * without affecting the caller
+ */
+PopplerDocument *rectanglevector_sampledocument(PopplerDocument *doc,
+		char *uri) {
+	PopplerDocument *sample;
+
+	if (uri == NULL || memoryceiling == 0)
+		return doc;
+	sample = poppler_document_new_from_file(uri, NULL, NULL);
+	if (sample == NULL)
+		return doc;
+	pagecache_document(sample);
+	return sample;
+}
+
+/*
+ * rectangles often taken by short blocks of text
+ */
+RectangleList *rectanglevector_frequent(PopplerDocument *doc,
+		gdouble height, gdouble distance) {
+	return rectanglevector_frequent_uri(doc, NULL, height, distance);
+}
+
+RectangleList *rectanglevector_frequent_uri(PopplerDocument *doc, char *uri,
+		gdouble height, gdouble distance) {
+	PopplerDocument *sample;
+	PopplerPage *page;
+	int npages, n, iterations, samplerate, used;
+	RectangleList *textarea;
+	RectangleVector *frequent;
+
+	frequent = rectanglevector_create(30);
+	sample = rectanglevector_sampledocument(doc, uri);
+	used = 0;
+
+	npages = poppler_document_get_n_pages(doc);
+	samplerate = rectanglevector_samplerate(npages);
+	srandom(time(NULL));
+
+	if (debugfrequent & (0x01 | 0x02))
+		printf("iterations:\n");
+	iterations = 0;
+	for (n = 0; n < npages; n++) {
+		if (random() % 100 > samplerate)
+			continue;
+		iterations++;
+		page = poppler_document_get_page(sample, n);
+		textarea = rectanglelist_textarea_distance(page, distance);
+		rectanglevector_frequent_add(frequent, textarea, height, n);
+		rectanglelist_free(textarea);
+		g_object_unref(page);
+		if (sample != doc)
+			sample = memory_recycle(sample, uri, &used);
+	}
+	if (sample != doc)
+		g_object_unref(sample);
+
+	return rectanglevector_frequent_list(frequent, iterations);
+}
+
 /*
  * the page minus page numbers, headers and footers
  */
@@ -1509,19 +3896,21 @@ PopplerRectangle *rectanglevector_main(PopplerDocument *doc,
 		RectangleList *recur, gdouble height, gdouble distance) {
 	PopplerPage *first;
 	PopplerRectangle page, *maintext;
-	RectangleList *subtract;
+	RectangleList *frequent, *subtract;
 	RectangleBound bound = {0.0, 0.0};
 
 	first = poppler_document_get_page(doc, 0);
 	rectangle_page(first, &page);
 	g_object_unref(first);
 
-	if (recur == NULL)
-		recur = rectanglevector_frequent(doc, height, distance);
+	frequent = recur != NULL ? recur :
+		rectanglevector_frequent(doc, height, distance);
 
-	subtract = rectanglelist_subtract1(&page, recur, NULL, &bound);
+	subtract = rectanglelist_subtract1(&page, frequent, NULL, &bound);
 	maintext = poppler_rectangle_copy(rectanglelist_largest(subtract));
 	rectanglelist_free(subtract);
+	if (frequent != recur)
+		rectanglelist_free(frequent);
 
 	return maintext;
 }
@@ -1668,10 +4057,11 @@ void rectanglelist_clip_containing(cairo_t *cr, PopplerPage *page,
 	poppler_page_get_size(page, &width, &height);
 
 	for (r = 0; r < textarea->num; r++)
-		for (s = 0; s < rm->num; s++) {
-			if (! rectangle_contain(&textarea->rect[r],
-					&rm->rect[s]))
-				continue;
+		for (s = rectanglelist_find(rm, &textarea->rect[r], 0,
+				rectangle_contained);
+		     s != -1;
+		     s = rectanglelist_find(rm, &textarea->rect[r], s + 1,
+				rectangle_contained)) {
 			if (debugfrequent & 0x04)
 				printf("    cut_rectangle: %d\n", s);
 			cairo_rectangle(cr, 0, 0, width, height);
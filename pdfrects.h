@@ -87,6 +87,29 @@ void rectangle_page(PopplerPage *page, PopplerRectangle *rect);
  */
 
 #define MAXRECT 4096
+
+/*
+ * coordinates of the rectangles of a list, in separate arrays
+ */
+typedef struct {
+	gint num;
+	gdouble *x1, *y1, *x2, *y2;
+} RectangleArrays;
+
+/*
+ * grid of cells, each with the rectangles of a list touching it
+ */
+typedef struct {
+	PopplerRectangle *rect;
+	gint num;
+	PopplerRectangle box;
+	gint cols, rows;
+	gdouble cellwidth, cellheight;
+	gint *start;
+	gint *cell;
+	RectangleArrays *arrays;
+} RectangleIndex;
+
 typedef struct {
 	/* public */
 	PopplerRectangle *rect;
@@ -94,6 +117,7 @@ typedef struct {
 
 	/* private */
 	gint max;
+	RectangleIndex *index;
 } RectangleList;
 
 /*
@@ -104,9 +128,77 @@ typedef struct {
 	gdouble each;
 } RectangleBound;
 
+/*
+ * allocation statistics: number of lists, of allocations and reallocations of
+ * their arrays of rectangles and of indexes built; bytes currently allocated
+ * for the arrays and their maximum; each thread has its own
+ */
+typedef struct {
+	long lists;
+	long arrays;
+	long indexes;
+	long bytes;
+	long peak;
+} RectangleStats;
+
+extern __thread RectangleStats rectanglestats;
+
+/* reset and print the allocation statistics */
+void rectanglestats_reset();
+void rectanglestats_printyaml(FILE *fd, char *indent);
+
+/*
+ * timing of the stages of the analysis of the pages: time and resulting
+ * rectangles of each stage, per page; pages are started by pagetiming_page()
+ * in each thread; pagetiming_report() prints totals, percentiles and the
+ * slowest pages
+ */
+#define STAGE_EXTRACT 0
+#define STAGE_CONSECUTIVE 1
+#define STAGE_WHITE 2
+#define STAGE_BLACK 3
+#define STAGE_JOIN 4
+#define STAGE_RASTER 5
+#define STAGE_HIERARCHY 6
+#define STAGE_ROWS 7
+#define STAGE_SORT 8
+#define STAGE_EMIT 9
+#define STAGES 10
+
+/* 0 = no timing, 1 = text report, 2 = json report */
+extern int pagetiming;
+extern char *pagetiming_stages[];
+
+/* enable timing, format "text" or "json"; NULL = $PDFTIMING, if set */
+gboolean pagetiming_enable(char *format);
+
+gint64 pagetiming_now();
+void pagetiming_stage(int stage, gint64 start, long count);
+void pagetiming_page(int npage);
+void pagetiming_endpage();
+void pagetiming_report(FILE *fd);
+
+/*
+ * memory ceiling in bytes (0 = none); when resident memory is near it,
+ * memory_recycle() reopens the document, which releases what poppler caches
+ */
+extern long memoryceiling;
+
+/* set the ceiling in megabytes; NULL = $PDFMEMORY, if set */
+gboolean memory_ceiling(char *megabytes);
+
+long memory_rss();
+long memory_peak();
+gboolean memory_near();
+PopplerDocument *memory_recycle(PopplerDocument *doc, char *uri, int *pages);
+void memory_report(FILE *fd);
+
 /* allocate a list with maximum number of elements, currently none */
 RectangleList *rectanglelist_new(int);
 
+/* make a list out of an array of rectangles, which is then owned by the list */
+RectangleList *rectanglelist_array(PopplerRectangle *rect, gint n);
+
 /* make a copy of a rectangle list */
 RectangleList *rectanglelist_copy(RectangleList *src);
 
@@ -121,6 +213,9 @@ void rectanglelist_print(FILE *, RectangleList *);
 void rectanglelist_printyaml(FILE *, char *first, char *indent,
 	RectangleList *);
 
+/* empty a list, keeping its allocated space */
+void rectanglelist_clear(RectangleList *);
+
 /* remove a rectangle from a list */
 void rectanglelist_delete(RectangleList *, gint);
 
@@ -145,6 +240,28 @@ double rectanglelist_sumheight(RectangleList *rl);
 double rectanglelist_averagewidth(RectangleList *rl);
 double rectanglelist_averageheight(RectangleList *rl);
 
+/* convert a rectangle list to separate arrays of coordinates and back */
+RectangleArrays *rectanglearrays_new(RectangleList *);
+RectangleList *rectanglearrays_list(RectangleArrays *);
+void rectanglearrays_free(RectangleArrays *);
+
+/* mark the rectangles from..to-1 in a relation to another; return how many */
+gint rectanglearrays_contain(RectangleArrays *, PopplerRectangle *,
+		gint from, gint to, guchar *mask);
+gint rectanglearrays_contained(RectangleArrays *, PopplerRectangle *,
+		gint from, gint to, guchar *mask);
+gint rectanglearrays_touch(RectangleArrays *, PopplerRectangle *,
+		gint from, gint to, guchar *mask);
+gint rectanglearrays_overlap(RectangleArrays *, PopplerRectangle *,
+		gint from, gint to, guchar *mask);
+
+/* drop the index of a list; required after changing its rectangles */
+void rectanglelist_unindex(RectangleList *);
+
+/* index of first rectangle from position from on in a relation to another */
+gint rectanglelist_find(RectangleList *, PopplerRectangle *, gint from,
+		gboolean (*relation)(PopplerRectangle *, PopplerRectangle *));
+
 /* index of first rectangle in list in a relation to another rectangle */
 gint rectanglelist_contain(RectangleList *, PopplerRectangle *);
 gint rectanglelist_touch(RectangleList *, PopplerRectangle *);
@@ -155,6 +272,10 @@ void rectanglelist_quicksort(RectangleList *, PopplerPage *);
 void rectanglelist_twosort(RectangleList *, PopplerPage *);
 void rectanglelist_charsort(RectangleList *, PopplerPage *);
 
+/* sort a rectangle list by the order of the characters in a text layout */
+void rectanglelist_charsort_layout(RectangleList *,
+		PopplerRectangle *rect, guint n);
+
 /* find the largest rectangle in a list or sort by area */
 PopplerRectangle *rectanglelist_largest(RectangleList *);
 void rectanglelist_areasort(RectangleList *);
@@ -164,6 +285,9 @@ gboolean rectanglelist_place(PopplerRectangle *page,
 		RectangleList *rl, PopplerRectangle *r,
 		PopplerRectangle *moved);
 
+/* algorithm for subtraction: 0 = incremental, 1 = sweep line */
+extern int subtractmethod;
+
 /* subtract a rectangle list from another: orig -= sub */
 gboolean rectanglelist_subtract(RectangleList **orig, RectangleList *sub,
 		PopplerRectangle *cont, RectangleBound *b);
@@ -172,9 +296,77 @@ gboolean rectanglelist_subtract(RectangleList **orig, RectangleList *sub,
 RectangleList *rectanglelist_subtract1(PopplerRectangle *r, RectangleList *rl,
 		PopplerRectangle *cont, RectangleBound *b);
 
+/* join consecutive touching rectangles of a list */
+void rectanglelist_consecutive(RectangleList *orig);
+
+/* join touching rectangles of a list until none touches another */
+void rectanglelist_join(RectangleList *orig);
+
+/*
+ * the text of a page: text, character rectangles and attributes, each
+ * fetched from poppler when first requested and freed by pagetext_free();
+ * from the page cache instead, if enabled and containing the page
+ */
+#define PAGECACHE_AREAS 8
+
+typedef struct {
+	PopplerPage *page;
+	PopplerRectangle bounds;
+	char *text;
+	PopplerRectangle *rect;
+	guint num;
+	gboolean layout;
+	GList *attributes;
+	gboolean attributed;
+
+	/* zone of the page analyzed, NULL = whole page */
+	PopplerRectangle *zone;
+
+	/* page cache: file, its mapping, textareas, whether to write */
+	char *cachefile;
+	void *map;
+	size_t mapsize;
+	struct {
+		gint kind;
+		gdouble distance;
+		RectangleList *rl;
+	} area[PAGECACHE_AREAS];
+	gint nareas;
+	gboolean dirty;
+} PageText;
+
+PageText *pagetext_new(PopplerPage *page);
+char *pagetext_text(PageText *pt);
+PopplerRectangle *pagetext_layout(PageText *pt, guint *num);
+GList *pagetext_attributes(PageText *pt);
+void pagetext_release(PageText *pt);
+void pagetext_free(PageText *pt);
+
+/* analyze only the characters in a zone (NULL = whole page), in its area */
+void pagetext_zone(PageText *pt, PopplerRectangle *zone);
+void pagetext_area(PageText *pt, PopplerRectangle *area);
+
+/*
+ * page cache: the text of the pages and their textareas are stored in files
+ * in a directory, one per page, named after the document id
+ */
+
+/* directory (NULL = $PDFPAGECACHE) and size in bytes (0 = default) */
+extern char *pagecachedir;
+extern long pagecachesize;
+
+/* pages in this thread are from this document (NULL = none, no cache) */
+void pagecache_document(PopplerDocument *doc);
+
+/* a textarea of a page from the cache (NULL if not there), store one */
+RectangleList *pagecache_area(PageText *pt, gint kind, gdouble distance);
+void pagecache_addarea(PageText *pt, gint kind, gdouble distance,
+		RectangleList *rl);
+
 /*
  * functions on text-enclosing rectangles
  * rectangles of white spaces ' ' are made 0-width
+ * the *_pagetext() variants take the text of the page from a PageText
  */
 
 /* debug */
@@ -182,15 +374,62 @@ extern int debugtextrectangles;
 
 /* the rectangles of the single characters in the page */
 RectangleList *rectanglelist_characters(PopplerPage *);
+RectangleList *rectanglelist_characters_pagetext(PageText *);
+
+/* sort by character order; or by order 0 = quick, 1 = two, 2 = char */
+void rectanglelist_charsort_pagetext(RectangleList *, PageText *);
+void rectanglelist_sort_pagetext(RectangleList *, PageText *, int order);
 
 /* area of text in a page */
 RectangleList *rectanglelist_textarea(PopplerPage *);
 
+/* algorithm for the textarea: 0 = subtraction, 1 = raster, 2 = hierarchy */
+extern int textareamethod;
+
 /* area of text in a page, with minimal distance considered a white space */
 RectangleList *rectanglelist_textarea_distance(PopplerPage *, gdouble);
+RectangleList *rectanglelist_textarea_distance_pagetext(PageText *, gdouble);
+
+/* approximate area of text from the characters in an area, by a raster */
+RectangleList *rectanglelist_textarea_raster(PopplerRectangle *area,
+		RectangleList *layout, gdouble distance);
+
+/*
+ * a pair of rectangles of a list, and their distance
+ */
+typedef struct {
+	gdouble distance;
+	gint a, b;
+} RectanglePair;
+
+/*
+ * the order in which the groups of consecutive characters of a page join when
+ * increasing the distance; their distances are in increasing order
+ */
+typedef struct {
+	RectangleList *blocks;
+	gint num;
+	RectanglePair *join;
+	gdouble distance;
+	gdouble maxdistance;
+} RectangleHierarchy;
+
+/* hierarchy of the blocks of text of a page, up to a maximal distance */
+RectangleHierarchy *rectanglehierarchy_new(PopplerPage *page,
+		gdouble maxdistance);
+RectangleHierarchy *rectanglehierarchy_new_pagetext(PageText *pt,
+		gdouble maxdistance);
+
+/* blocks of text of a hierarchy for a distance (-1 = default) */
+RectangleList *rectanglehierarchy_cut(RectangleHierarchy *h,
+		gdouble distance);
+
+/* free a hierarchy */
+void rectanglehierarchy_free(RectangleHierarchy *h);
 
 /* bounding box of the page or document (NULL if no text) */
 PopplerRectangle *rectanglelist_boundingbox(PopplerPage *);
+PopplerRectangle *rectanglelist_boundingbox_pagetext(PageText *);
 PopplerRectangle *rectanglelist_boundingbox_document(PopplerDocument *doc);
 
 /* largest box in a page or document (NULL if no text) */
@@ -208,6 +447,7 @@ PopplerRectangle *rectanglelist_boundingbox_painted(PopplerPage *page, int d);
 
 /* list of rows in a page */
 RectangleList *rectanglelist_rows(PopplerPage *page, gdouble distance);
+RectangleList *rectanglelist_rows_pagetext(PageText *pt, gdouble distance);
 
 /*
  * functions for recurring blocks of text (page numbers, headers and footers)
@@ -246,6 +486,20 @@ void rectanglevector_add(RectangleVector *v, PopplerRectangle *r);
 RectangleList *rectanglevector_frequent(PopplerDocument *doc,
 		gdouble height, gdouble distance);
 
+/* the same, sampling on a copy of the document within the memory ceiling */
+PopplerDocument *rectanglevector_sampledocument(PopplerDocument *doc,
+		char *uri);
+RectangleList *rectanglevector_frequent_uri(PopplerDocument *doc, char *uri,
+		gdouble height, gdouble distance);
+
+/* the same, from the textareas of pages sampled by the caller: percentage of
+ * pages to sample, add a textarea of page n, final list (frees the vector) */
+int rectanglevector_samplerate(int npages);
+void rectanglevector_frequent_add(RectangleVector *frequent,
+		RectangleList *textarea, gdouble height, int n);
+RectangleList *rectanglevector_frequent_list(RectangleVector *frequent,
+		int iterations);
+
 /* a rectangle as large as the page minus headers and footers */
 PopplerRectangle *rectanglevector_main(PopplerDocument *doc,
 		RectangleList *recur, gdouble height, gdouble distance);
@@ -28,7 +28,7 @@ int main(int argc, char *argv[]) {
 
 	PopplerDocument *doc;
 	PopplerPage *page;
-	int npages, n;
+	int npages, n, used;
 	gdouble width, height;
 	RectangleList *textarea, *flist;
 	PopplerRectangle *maintext;
@@ -38,7 +38,9 @@ int main(int argc, char *argv[]) {
 
 				/* arguments */
 
-	while ((opt = getopt(argc, argv, "s:t:mcdnh")) != -1)
+	if (! memory_ceiling(NULL))
+		printf("PDFMEMORY is not a size in MB, ignored\n");
+	while ((opt = getopt(argc, argv, "s:t:M:mcdnh")) != -1)
 		switch(opt) {
 		case 's':
 			height = atof(optarg);
@@ -46,6 +48,12 @@ int main(int argc, char *argv[]) {
 		case 't':
 			distance = atof(optarg);
 			break;
+		case 'M':
+			if (! memory_ceiling(optarg)) {
+				printf("-M requires a size in megabytes\n");
+				usage = TRUE;
+			}
+			break;
 		case 'm':
 			usemain = TRUE;
 			break;
@@ -71,13 +79,14 @@ int main(int argc, char *argv[]) {
 		printf("usage:\n");
 		printf("\tpdfrecur ");
 		printf("[-s height] [-t distance] [-d] [-m] [-c] [-n] ");
-		printf("[-h] file.pdf\n");
+		printf("[-M mb] [-h] file.pdf\n");
 		printf("\t\t-s height\tmaximal height of recurring text\n");
 		printf("\t\t-t distance\ttext-to-text distance\n");
 		printf("\t\t-d\t\tdraw a box around removed rectangles\n");
 		printf("\t\t-m\t\tuse the main text block in the page\n");
 		printf("\t\t-c\t\tdo not remove recurring rectangles\n");
 		printf("\t\t-n\t\tonly print recurring rectangles\n");
+		printf("\t\t-M mb\t\tmemory ceiling in megabytes\n");
 		printf("\t\t-h\t\tthis help\n");
 		exit(EXIT_FAILURE);
 	}
@@ -94,6 +103,7 @@ int main(int argc, char *argv[]) {
 		printf("error opening pdf file\n");
 		exit(EXIT_FAILURE);
 	}
+	pagecache_document(doc);
 
 				/* pages */
 
@@ -105,15 +115,18 @@ int main(int argc, char *argv[]) {
 
 				/* find the recurring text blocks */
 
-	flist = rectanglevector_frequent(doc, recurheight, distance);
+	flist = rectanglevector_frequent_uri(doc, infile,
+		recurheight, distance);
 	if (usemain) {
 		maintext = rectanglevector_main(doc, flist,
 			recurheight, distance);
 		printf("maintext:\n");
 		rectangle_printyaml(stdout, "  - ", "    ", maintext);
 	}
-	if (noout)
+	if (noout) {
+		memory_report(stderr);
 		return 0;
+	}
 
 				/* copy to destination */
 
@@ -123,6 +136,7 @@ int main(int argc, char *argv[]) {
 	printf("outfile: %s\n", outfile);
 	printf("pages: \n");
 
+	used = 0;
 	for (n = 0; n < npages; n++) {
 		printf("  - page: %d\n", n);
 		page = poppler_document_get_page(doc, n);
@@ -154,10 +168,13 @@ int main(int argc, char *argv[]) {
 		cairo_destroy(cr);
 		cairo_surface_show_page(surface);
 
+		rectanglelist_free(textarea);
 		g_object_unref(page);
+		doc = memory_recycle(doc, infile, &used);
 	}
 
 	cairo_surface_destroy(surface);
+	memory_report(stderr);
 
 	return EXIT_SUCCESS;
 }
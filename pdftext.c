@@ -7,6 +7,8 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <stdarg.h>
+#include <time.h>
 #include <poppler.h>
 #include "pdfrects.h"
 #include "pdftext.h"
@@ -20,7 +22,10 @@ struct format format_roff = {
 	"\\fR", "\\fI", "\\fB", "\\f[BI]",
 	"", "", "", "",
 	FALSE,
-	"\\", "\\[char46]", "<", ">", "&"
+	"\\", "\\[char46]", "<", ">", "&",
+	{NULL},
+	FACES_NONE,
+	FALSE
 };
 struct format format_html = {
 	"\n<p>", "</p>\n",
@@ -28,7 +33,10 @@ struct format format_html = {
 	"", "", "", "",
 	"<i>", "</i>", "<b>", "</b>",
 	TRUE,
-	"\\", ".", "&lt;", "&gt;", "&amp;"
+	"\\", ".", "&lt;", "&gt;", "&amp;",
+	{NULL},
+	FACES_NONE,
+	FALSE
 };
 struct format format_tex = {
 	"", "\n\n",
@@ -36,7 +44,10 @@ struct format format_tex = {
 	"\\rm ", "\\it ", "\\bf ", "\\bf ", /* FIXME: bold+italic */
 	"", "", "", "",
 	FALSE,
-	"\\backslash ", ".", "<", ">", "\\& "
+	"\\backslash ", ".", "<", ">", "\\& ",
+	{NULL},
+	FACES_NONE,
+	FALSE
 };
 struct format format_textfont = {
 	"", "\n",
@@ -44,7 +55,10 @@ struct format format_textfont = {
 	"", "", "", "",
 	"", "", "", "",
 	FALSE,
-	"\\\\", ".", "<", ">", "&"
+	"\\\\", ".", "<", ">", "&",
+	{NULL},
+	FACES_NONE,
+	FALSE
 };
 struct format format_text = {
 	"", "\n",
@@ -52,72 +66,212 @@ struct format format_text = {
 	"", "", "", "",
 	"", "", "", "",
 	FALSE,
-	"\\", ".", "<", ">", "&"
+	"\\", ".", "<", ">", "&",
+	{NULL},
+	FACES_NONE,
+	FALSE
 };
 
+/*
+ * output buffer: the text of a page is accumulated in memory and written at
+ * once when the page is complete
+ */
+void textout_write(struct textout *out, char *s, size_t n) {
+	if (out->len + n > out->max) {
+		out->max = MAX(out->max * 2, out->len + n + 4096);
+		out->data = realloc(out->data, out->max);
+	}
+	memcpy(out->data + out->len, s, n);
+	out->len += n;
+}
+
+void textout_puts(struct textout *out, char *s) {
+	textout_write(out, s, strlen(s));
+}
+
+void textout_putc(struct textout *out, char c) {
+	if (out->len < out->max)
+		out->data[out->len++] = c;
+	else
+		textout_write(out, &c, 1);
+}
+
+void textout_printf(struct textout *out, char *format, ...) {
+	va_list ap;
+	int n;
+
+	va_start(ap, format);
+	n = vsnprintf(NULL, 0, format, ap);
+	va_end(ap);
+	if (n < 0)
+		return;
+	if (out->len + n + 1 > out->max) {
+		out->max = MAX(out->max * 2, out->len + n + 1 + 4096);
+		out->data = realloc(out->data, out->max);
+	}
+	va_start(ap, format);
+	vsnprintf(out->data + out->len, n + 1, format, ap);
+	va_end(ap);
+	out->len += n;
+}
+
+void textout_flush(struct textout *out, FILE *fd) {
+	fwrite(out->data, 1, out->len, fd);
+	out->len = 0;
+}
+
+void textout_free(struct textout *out) {
+	free(out->data);
+	out->data = NULL;
+	out->len = 0;
+	out->max = 0;
+}
+
+/*
+ * precompute the replacements of the characters to be escaped and which font
+ * strings are used; a format without any does not need the fonts of the text
+ */
+void formatcompile(struct format *format) {
+	memset(format->escape, 0, sizeof(format->escape));
+	format->escape['\\'] = format->backslash;
+	format->escape['<'] = format->less;
+	format->escape['>'] = format->greater;
+	format->escape['&'] = format->and;
+
+	format->faces = FACES_NONE;
+	if (*format->fontname != '\0' ||
+	    *format->plain != '\0' || *format->italic != '\0' ||
+	    *format->bold != '\0' || *format->bolditalic != '\0')
+		format->faces |= FACES_SET;
+	if (*format->italicbegin != '\0' || *format->italicend != '\0' ||
+	    *format->boldbegin != '\0' || *format->boldend != '\0')
+		format->faces |= FACES_TAGS;
+	format->compiled = TRUE;
+}
+
 /*
  * print reason for a paragraph break
  */
 gboolean debugpar = FALSE;
-void dnewpar(FILE *fd, char *why) {
+void dnewpar(struct textout *out, char *why) {
 	if (debugpar)
-		fputs(why, fd);
+		textout_puts(out, why);
 }
-void delement(FILE *fd, char *what, int num) {
+void delement(struct textout *out, char *what, int num) {
 	if (debugpar)
-		fprintf(fd, what, num);
+		textout_printf(out, what, num);
 }
 
 /*
- * start or end a font face
- *	start	TRUE to start the new face, FALSE to end the previous
- *	reset	TRUE to temporarily end or restore all active faces
+ * style of the fonts of the runs of text of a page: italic, bold; each font
+ * name is checked once per page, the other runs with the same font take the
+ * result from a table by name
  */
-void face(FILE *fd, gboolean start, gboolean reset,
-		gboolean *italic, gboolean *bold,
-		PopplerTextAttributes *attr, struct format *format) {
-	gboolean newitalic, newbold;
-
-	if (reset && ! format->reset)
-		return;
+#define STYLE_ITALIC 0x01
+#define STYLE_BOLD   0x02
+#define STYLE_KNOWN  0x80
 
-	newitalic = NULL != strstr(attr->font_name, "Italic");
-	newbold = NULL != strstr(attr->font_name, "Bold");
-
-				/* font name */
+guchar *textstyles(GList *attrlist) {
+	guchar *styles;
+	GList *attrelem;
+	PopplerTextAttributes *attr;
+	GHashTable *known;
+	guchar style;
+	int i;
+
+	styles = malloc(g_list_length(attrlist) + 1);
+	known = g_hash_table_new(g_str_hash, g_str_equal);
+	for (attrelem = attrlist, i = 0;
+	     attrelem != NULL;
+	     attrelem = g_list_next(attrelem), i++) {
+		attr = (PopplerTextAttributes *) attrelem->data;
+		style = GPOINTER_TO_UINT(g_hash_table_lookup(known,
+			attr->font_name));
+		if (style == 0) {
+			style = STYLE_KNOWN |
+				(strstr(attr->font_name, "Italic") != NULL ?
+					STYLE_ITALIC : 0) |
+				(strstr(attr->font_name, "Bold") != NULL ?
+					STYLE_BOLD : 0);
+			g_hash_table_insert(known, attr->font_name,
+				GUINT_TO_POINTER(style));
+		}
+		styles[i] = style & ~STYLE_KNOWN;
+	}
+	g_hash_table_destroy(known);
+	return styles;
+}
 
+/*
+ * font face in a format that sets it: font name, then the string of the face;
+ * nothing at its end except for resets
+ */
+void faceset(struct textout *out, gboolean start, gboolean reset,
+		gboolean newitalic, gboolean newbold,
+		PopplerTextAttributes *attr, struct format *format) {
 	if (start && ! reset && *format->fontname != '\0')
-		fprintf(fd, format->fontname, attr->font_name);
-
-				/* font start, no end except for resets */
+		textout_printf(out, format->fontname, attr->font_name);
 
 	if (start) {
 		if (! newitalic && ! newbold)
-			fputs(format->plain, fd);
+			textout_puts(out, format->plain);
 		else if (newitalic && ! newbold)
-			fputs(format->italic, fd);
+			textout_puts(out, format->italic);
 		else if (! newitalic && newbold)
-			fputs(format->bold, fd);
+			textout_puts(out, format->bold);
 		if (newitalic && newbold)
-			fputs(format->bolditalic, fd);
+			textout_puts(out, format->bolditalic);
 	}
 	if (! start && reset)
-		fputs(format->plain, fd);
-
-				/* font start-end */
+		textout_puts(out, format->plain);
+}
 
+/*
+ * font face in a format that begins and ends it
+ */
+void facetags(struct textout *out, gboolean start, gboolean reset,
+		gboolean italic, gboolean bold,
+		gboolean newitalic, gboolean newbold,
+		struct format *format) {
 	if (! start) {
-		if (*bold && newbold == reset)
-			fputs(format->boldend, fd);
-		if (*italic && newitalic == reset)
-			fputs(format->italicend, fd);
+		if (bold && newbold == reset)
+			textout_puts(out, format->boldend);
+		if (italic && newitalic == reset)
+			textout_puts(out, format->italicend);
 	}
 	else {
-		if (*italic == reset && newitalic)
-			fputs(format->italicbegin, fd);
-		if (*bold == reset && newbold)
-			fputs(format->boldbegin, fd);
+		if (italic == reset && newitalic)
+			textout_puts(out, format->italicbegin);
+		if (bold == reset && newbold)
+			textout_puts(out, format->boldbegin);
 	}
+}
+
+/*
+ * start or end a font face
+ *	start	TRUE to start the new face, FALSE to end the previous
+ *	reset	TRUE to temporarily end or restore all active faces
+ *
+ * only the variants for the font strings of the format are called, as
+ * precomputed by formatcompile()
+ */
+void face(struct textout *out, gboolean start, gboolean reset,
+		gboolean *italic, gboolean *bold,
+		PopplerTextAttributes *attr, guchar style,
+		struct format *format) {
+	gboolean newitalic, newbold;
+
+	if (reset && ! format->reset)
+		return;
+
+	newitalic = (style & STYLE_ITALIC) != 0;
+	newbold = (style & STYLE_BOLD) != 0;
+
+	if (format->faces & FACES_SET)
+		faceset(out, start, reset, newitalic, newbold, attr, format);
+	if (format->faces & FACES_TAGS)
+		facetags(out, start, reset, *italic, *bold,
+			newitalic, newbold, format);
 
 				/* update current font */
 
@@ -130,44 +284,31 @@ void face(FILE *fd, gboolean start, gboolean reset,
 /*
  * show a single character
  *	rest	character not written (hyphen at end of line) or NONE
+ *
+ * the characters to escape are looked up in the table of the format; the
+ * ligatures are the code points from U+FB00 on
  */
-void showcharacter(FILE *fd, char *cur, char *next, char *rest,
+void showcharacter(struct textout *out, char *cur, char *next, char *rest,
 		gboolean newpar, char hyphen, struct format *format) {
-	char *ligatures[] = {
-		"ff",  "\xef\xac\x80",
-		"fi",  "\xef\xac\x81",
-		"fl",  "\xef\xac\x82",
-		"ffi", "\xef\xac\x83",
-		"ffl", "\xef\xac\x84",
-		"st",  "\xef\xac\x85",
-		"st",  "\xef\xac\x86",
-		NULL,  NULL
-	};
-	int l;
+	char *ligatures[] = {"ff", "fi", "fl", "ffi", "ffl", "st", "st"};
+	gunichar c;
+	char *e;
 
 	*rest = NONE;
-	if (*cur == '\\')
-		fputs(format->backslash, fd);
+	if ((e = format->escape[(guchar) *cur]) != NULL)
+		textout_puts(out, e);
 	else if (newpar && *cur == '.')
-		fputs(format->firstdot, fd);
-	else if (*cur == '<')
-		fputs(format->less, fd);
-	else if (*cur == '>')
-		fputs(format->greater, fd);
-	else if (*cur == '&')
-		fputs(format->and, fd);
+		textout_puts(out, format->firstdot);
 	else if (*cur == hyphen && (*next == '\0' || *next == '\n'))
 		*rest = '-';
+	else if (next - cur == 1)
+		textout_putc(out, *cur);
 	else {
-		for (l = 0; ligatures[l] != NULL; l += 2) {
-			if ((int) strlen(ligatures[l + 1]) != next - cur)
-				continue;
-			if (! memcmp(ligatures[l + 1], cur, next - cur)) {
-				fputs(ligatures[l], fd);
-				return;
-			}
-		}
-		fwrite(cur, 1, next - cur, fd);
+		c = g_utf8_get_char(cur);
+		if (c >= 0xFB00 && c <= 0xFB06)
+			textout_puts(out, ligatures[c - 0xFB00]);
+		else
+			textout_write(out, cur, next - cur);
 	}
 }
 
@@ -232,29 +373,66 @@ void startpage(struct scandata *scanpage) {
  *	textarea	the blocks of text in the page
  *			may also be the whole page or its bounding box
  *	text, attrlist, rects, nrects
- *			characters and their fonts and positions
+ *			characters and their fonts and positions; attrlist
+ *			and styles are NULL if the format uses no font
+ *	offsets, chars, nchars
+ *			if chars is not NULL, only the characters of these
+ *			indexes are scanned, in this order; offsets[i] is the
+ *			position in text of the character of index i; the
+ *			output is the same as when scanning all characters if
+ *			chars are the increasing indexes of the characters
+ *			in zone
  *	detectcolumns	whether to detect the start of a new column during the
  *			scan, by comparing the position of the current
  *			character with that of the current column and previous
  *			character; only used when textarea=page
+ *
+ * the start of a column is the minimal x and y of the characters from the
+ * current to the end of the page, excluding the measure->headfooter ones at
+ * the end; they are precomputed as suffix minima: minx[r] and miny[r] are the
+ * minima from r on
  */
-void showregion(FILE *fd, PopplerRectangle *zone, RectangleList *textarea,
-		char *text, GList *attrlist,
+void showregion_chars(struct textout *out, PopplerRectangle *zone,
+		RectangleList *textarea,
+		char *text, GList *attrlist, guchar *styles,
 		PopplerRectangle *rects, guint nrects,
+		guint *offsets, gint *chars, gint nchars,
 		struct measure *measure, struct format *format,
 		struct scandata *scandata, gboolean detectcolumn) {
 	char *cur, *next;
-	int count;
+	int count, i;
 	gdouble left, y;
 
 	GList *attrelem;
+	int ai;
+	guchar style;
 	int ti = -1;
 	PopplerRectangle *tr;
 	PopplerTextAttributes *attr;
 	gboolean startcolumn, shortline, newline;
 
 	PopplerRectangle crect;
-	guint r;
+	gint r, end;
+	gdouble *minx, *miny;
+
+	if (! format->compiled)
+		formatcompile(format);
+
+				/* suffix minima for the start of columns */
+
+	minx = NULL;
+	miny = NULL;
+	end = (gint) nrects - measure->headfooter;
+	if (detectcolumn && end > 0) {
+		minx = malloc((end + 1) * sizeof(gdouble));
+		miny = malloc((end + 1) * sizeof(gdouble));
+		minx[end] = 10000;
+		miny[end] = 10000;
+		for (r = end - 1; r >= 0; r--) {
+			minx[r] = MIN(minx[r + 1], rects[r].x1);
+			miny[r] = MIN(miny[r + 1], rects[r].y1);
+		}
+	}
 
 				/* cycle over (utf-8) characters in page */
 
@@ -262,9 +440,19 @@ void showregion(FILE *fd, PopplerRectangle *zone, RectangleList *textarea,
 	startcolumn = TRUE;
 
 	attrelem = attrlist;
-	attr = (PopplerTextAttributes *) (attrelem->data);
-
-	for (cur = text, count = 0; *cur; cur = next, count++) {
+	attr = attrelem == NULL ?
+		NULL : (PopplerTextAttributes *) (attrelem->data);
+	ai = 0;
+	style = styles == NULL ? 0 : styles[ai];
+
+	for (i = 0, cur = text;
+	     chars == NULL ? *cur != '\0' : i < nchars;
+	     i++, cur = next) {
+		count = i;
+		if (chars != NULL) {
+			count = chars[i];
+			cur = text + offsets[count];
+		}
 		crect = rects[count];
 		next = g_utf8_next_char(cur);
 		if (zone != NULL && ! rectangle_contain(zone, &crect))
@@ -276,11 +464,11 @@ void showregion(FILE *fd, PopplerRectangle *zone, RectangleList *textarea,
 			newline = FALSE;
 		else {
 			ti = rectanglelist_contain(textarea, &crect);
-			delement(fd, "[BLOCK %d]", ti);
+			delement(out, "[BLOCK %d]", ti);
 			if (ti != -1)
 				tr = &textarea->rect[ti];
 			else if (*cur == ' ') {
-				dnewpar(fd, "_SPACE_");
+				dnewpar(out, "_SPACE_");
 				tr = &crect;
 			}
 			else
@@ -294,14 +482,14 @@ void showregion(FILE *fd, PopplerRectangle *zone, RectangleList *textarea,
 
 		if (*cur == '\n' || newline) {
 			if (shortline) {
-				dnewpar(fd, "[S]");
+				dnewpar(out, "[S]");
 				scandata->newpar = TRUE;
 			}
 			else {
 				if (scandata->prev == '-')
-					dnewpar(fd, "[-]");
+					dnewpar(out, "[-]");
 				else
-					dnewpar(fd, "[]");
+					dnewpar(out, "[]");
 				scandata->prev =
 					scandata->prev == '-' ||
 					scandata->prev == START ?
@@ -320,15 +508,10 @@ void showregion(FILE *fd, PopplerRectangle *zone, RectangleList *textarea,
 				startcolumn = TRUE;
 
 			if (detectcolumn && startcolumn) {
-				dnewpar(fd, "[COLUMN]");
-				left = 10000;
-				y = 10000;
-				for (r = MAX(measure->headfooter, count);
-				     r + measure->headfooter < nrects;
-				     r++) {
-					left = MIN(left, rects[r].x1);
-					y = MIN(y, rects[r].y1);
-				}
+				dnewpar(out, "[COLUMN]");
+				r = MAX(measure->headfooter, count);
+				left = r < end ? minx[r] : 10000;
+				y = r < end ? miny[r] : 10000;
 				if (left == 10000)
 					y = 0; /* few chars, force newpar */
 				y -= measure->newline + 1;
@@ -339,14 +522,14 @@ void showregion(FILE *fd, PopplerRectangle *zone, RectangleList *textarea,
 
 			if (crect.y1 - y > measure->newline) {
 				if (crect.y1 - y > measure->newpar) {
-					dnewpar(fd, "[V]");
-					fputs(format->parend, fd);
-					fputs(format->parstart, fd);
+					dnewpar(out, "[V]");
+					textout_puts(out, format->parend);
+					textout_puts(out, format->parstart);
 					scandata->newpar = TRUE;
 				}
 				y = crect.y1;
 				if (crect.x1 - left > measure->indent) {
-					dnewpar(fd, "[I]");
+					dnewpar(out, "[I]");
 					scandata->newpar = TRUE;
 				}
 			}
@@ -354,31 +537,31 @@ void showregion(FILE *fd, PopplerRectangle *zone, RectangleList *textarea,
 					/* new paragraph */
 
 			if (scandata->newpar) {
-				face(fd, FALSE, TRUE,
+				face(out, FALSE, TRUE,
 					&scandata->italic, &scandata->bold,
-					attr, format);
+					attr, style, format);
 				if (scandata->prev != START)
-					fputs(format->parend, fd);
-				fputs(format->parstart, fd);
-				face(fd, TRUE, TRUE,
+					textout_puts(out, format->parend);
+				textout_puts(out, format->parstart);
+				face(out, TRUE, TRUE,
 					&scandata->italic, &scandata->bold,
-					attr, format);
+					attr, style, format);
 			}
 			else if (scandata->prev > START)
-				fprintf(fd, "%c", scandata->prev);
+				textout_putc(out, scandata->prev);
 
 					/* start a new font face */
 
 			if (scandata->newface && *cur != ' ') {
-				face(fd, TRUE, FALSE,
+				face(out, TRUE, FALSE,
 					&scandata->italic, &scandata->bold,
-					attr, format);
+					attr, style, format);
 				scandata->newface = FALSE;
 			}
 
 					/* print character */
 
-			showcharacter(fd, cur, next,
+			showcharacter(out, cur, next,
 				&scandata->prev, scandata->newpar,
 				measure->hyphen, format);
 
@@ -388,21 +571,33 @@ void showregion(FILE *fd, PopplerRectangle *zone, RectangleList *textarea,
 			scandata->newpar = FALSE;
 		}
 
+				/* without fonts, the page is a single run of
+				 * text ending at its last character, where
+				 * the scan stops as with fonts */
+
+		if (attr == NULL) {
+			if (count == (gint) nrects - 1 -
+			    (g_unichar_isspace(*next) ? 1 : 0))
+				break;
+		}
+
 				/* end of text with current font; read next */
 
-		if (count == attr->end_index -
+		else if (count == attr->end_index -
 			     (g_unichar_isspace(*next) ? 1 : 0)) {
 			attrelem = g_list_next(attrelem);
 			if (! attrelem) {
-				face(fd, FALSE, TRUE,
+				face(out, FALSE, TRUE,
 					&scandata->italic, &scandata->bold,
-					attr, format);
+					attr, style, format);
 				break;
 			}
 			attr = (PopplerTextAttributes *) (attrelem->data);
-			face(fd, FALSE, FALSE,
+			ai++;
+			style = styles[ai];
+			face(out, FALSE, FALSE,
 				&scandata->italic, &scandata->bold,
-				attr, format);
+				attr, style, format);
 			scandata->newface = TRUE;
 		}
 	}
@@ -410,124 +605,459 @@ void showregion(FILE *fd, PopplerRectangle *zone, RectangleList *textarea,
 				/* shortline at end */
 
 	if (shortline) {
-		dnewpar(fd, "[E]");
+		dnewpar(out, "[E]");
 		scandata->newpar = TRUE;
 	}
+
+	free(minx);
+	free(miny);
 }
 
 /*
- * show the characters in a page
+ * show the characters of a page contained in a box, scanning all of them
  */
-void showpage(FILE *fd, PopplerPage *page, PopplerRectangle *zone,
-		int method, int order,
+void showregion(FILE *fd, PopplerRectangle *zone, RectangleList *textarea,
+		char *text, GList *attrlist,
+		PopplerRectangle *rects, guint nrects,
 		struct measure *measure, struct format *format,
-		struct scandata *scandata) {
-	char *text;
-	GList *attrlist;
-	PopplerRectangle *rects, *tr, *region;
-	guint nrects;
-	RectangleList *textarea;
-	gint r;
-	void (*sort[])(RectangleList *, PopplerPage *) = {
-		rectanglelist_quicksort,
-		rectanglelist_twosort,
-		rectanglelist_charsort
-	};
+		struct scandata *scandata, gboolean detectcolumn) {
+	struct textout out = {NULL, 0, 0};
+	guchar *styles;
+
+	styles = attrlist == NULL ? NULL : textstyles(attrlist);
+	showregion_chars(&out, zone, textarea, text, attrlist, styles,
+		rects, nrects, NULL, NULL, 0,
+		measure, format, scandata, detectcolumn);
+	textout_flush(&out, fd);
+	textout_free(&out);
+	free(styles);
+}
 
-				/* initalize output font */
+/*
+ * show the characters of a page block by block
+ *	zone		only characters in this box are shown
+ *			NULL = all characters in page
+ *	blocks		the blocks, in the order they are shown
+ *	after		string printed after each block
+ *
+ * same as calling showregion() on each block intersected with the zone, but
+ * each character is assigned its blocks once: a zone-block intersection
+ * containing it is found by the index of the list of these intersections;
+ * then each block is shown by scanning only its characters
+ */
+void showblocks(struct textout *out, PopplerRectangle *zone,
+		RectangleList *blocks,
+		char *text, GList *attrlist, guchar *styles,
+		PopplerRectangle *rects, guint nrects,
+		struct measure *measure, struct format *format,
+		struct scandata *scandata, char *after) {
+	RectangleList *regions;
+	gboolean *skip;
+	guint *offsets, n;
+	gint *pair, npair, maxpair, *start, *chars;
+	gint r, k;
+	char *cur;
+
+				/* regions: blocks intersected with the zone */
+
+	regions = rectanglelist_new(blocks->num);
+	skip = malloc(blocks->num * sizeof(gboolean));
+	for (r = 0; r < blocks->num; r++) {
+		skip[r] = zone != NULL &&
+			! rectangle_overlap(zone, &blocks->rect[r]);
+		rectanglelist_append(regions, &blocks->rect[r]);
+		if (zone != NULL && ! skip[r])
+			rectangle_intersect(&regions->rect[r],
+				zone, &blocks->rect[r]);
+	}
 
-	startpage(scandata);
+				/* offsets of characters, pairs (region, char) */
+
+	offsets = malloc((nrects + 1) * sizeof(guint));
+	maxpair = nrects + 1;
+	pair = malloc(maxpair * 2 * sizeof(gint));
+	npair = 0;
+	for (cur = text, n = 0; *cur && n < nrects;
+	     cur = g_utf8_next_char(cur), n++) {
+		offsets[n] = cur - text;
+		for (k = rectanglelist_find(regions, &rects[n], 0,
+				rectangle_contain);
+		     k != -1;
+		     k = rectanglelist_find(regions, &rects[n], k + 1,
+				rectangle_contain)) {
+			if (skip[k])
+				continue;
+			if (npair >= maxpair) {
+				maxpair *= 2;
+				pair = realloc(pair, maxpair * 2 * sizeof(gint));
+			}
+			pair[2 * npair] = k;
+			pair[2 * npair + 1] = n;
+			npair++;
+		}
+	}
 
-				/* get page content */
+				/* characters of each region, in order */
+
+	start = calloc(blocks->num + 1, sizeof(gint));
+	for (k = 0; k < npair; k++)
+		start[pair[2 * k] + 1]++;
+	for (r = 0; r < blocks->num; r++)
+		start[r + 1] += start[r];
+	chars = malloc((npair + 1) * sizeof(gint));
+	for (k = 0; k < npair; k++)
+		chars[start[pair[2 * k]]++] = pair[2 * k + 1];
+	for (r = blocks->num; r > 0; r--)
+		start[r] = start[r - 1];
+	start[0] = 0;
+
+				/* show each region */
+
+	for (r = 0; r < blocks->num; r++) {
+		delement(out, "[=== BLOCK %d]", r);
+		if (skip[r])
+			continue;
+		showregion_chars(out, &regions->rect[r], blocks,
+			text, attrlist, styles, rects, nrects,
+			offsets, chars + start[r], start[r + 1] - start[r],
+			measure, format, scandata, FALSE);
+		textout_puts(out, after);
+	}
 
-	text = poppler_page_get_text(page);
-	attrlist = poppler_page_get_text_attributes(page);
-	if (! text || ! attrlist)
-		return;		/* no text in page */
-	if (! poppler_page_get_text_layout(page, &rects, &nrects))
-		return;		/* no text in page */
+	free(chars);
+	free(start);
+	free(pair);
+	free(offsets);
+	free(skip);
+	rectanglelist_free(regions);
+}
 
-				/* analyze text */
+/*
+ * the data of a page needed for showing its characters: text, fonts,
+ * positions and blocks of text; it does not refer to the page, so that it can
+ * be computed in a thread and shown in another
+ */
+struct pagedata {
+	PageText *pagetext;
+	char *text;
+	GList *attrlist;
+	guchar *styles;
+	PopplerRectangle *rects;
+	guint nrects;
+	RectangleList *textarea;
+};
+
+/*
+ * find the blocks of text of a page whose characters are already in data;
+ * return FALSE if no character is in the zone of analysis
+ */
+gboolean textareapage(PopplerPage *page, int method, int order,
+		struct measure *measure, struct pagedata *data) {
+	PopplerRectangle *tr;
 
 	switch (method) {
 	case 0:
 		tr = poppler_rectangle_new();
 		poppler_page_get_crop_box(page, tr);
-		textarea = rectanglelist_new(1);
-		rectanglelist_add(textarea, tr);
-		showregion(fd, zone, textarea, text, attrlist, rects, nrects,
-			measure, format, scandata, TRUE);
+		data->textarea = rectanglelist_new(1);
+		rectanglelist_add(data->textarea, tr);
 		poppler_rectangle_free(tr);
 		break;
 	case 1:
-		tr = rectanglelist_boundingbox(page);
-		textarea = rectanglelist_new(1);
-		rectanglelist_add(textarea, tr);
-		showregion(fd, zone, textarea, text, attrlist, rects, nrects,
-			measure, format, scandata, FALSE);
+		tr = rectanglelist_boundingbox_pagetext(data->pagetext);
+		if (tr == NULL)
+			return FALSE;
+		data->textarea = rectanglelist_new(1);
+		rectanglelist_add(data->textarea, tr);
 		poppler_rectangle_free(tr);
 		break;
 	case 2:
-		textarea = rectanglelist_textarea_distance(page,
-				measure->blockdistance);
-		showregion(fd, zone, textarea, text, attrlist, rects, nrects,
-			measure, format, scandata, FALSE);
+		data->textarea = rectanglelist_textarea_distance_pagetext(
+				data->pagetext, measure->blockdistance);
 		break;
 	case 3:
-		textarea = rectanglelist_textarea_distance(page,
+		data->textarea = rectanglelist_textarea_distance_pagetext(
+				data->pagetext, measure->blockdistance);
+		rectanglelist_sort_pagetext(data->textarea,
+				data->pagetext, order);
+		break;
+	case 4:
+		data->textarea = rectanglelist_rows_pagetext(data->pagetext,
 				measure->blockdistance);
-		sort[order](textarea, page);
-		region = poppler_rectangle_new();
-		for (r = 0; r < textarea->num; r++) {
-			delement(fd, "[=== BLOCK %d]", r);
-			if (zone == NULL) {
-				showregion(fd, &textarea->rect[r], textarea,
-					text, attrlist, rects, nrects,
-					measure, format, scandata, FALSE);
-				continue;
+		break;
+	default:
+		fprintf(stderr, "no such conversion method: %d\n", method);
+		exit(EXIT_FAILURE);
+	}
+
+	return TRUE;
+}
+
+/*
+ * get the characters of a page in data, whose pagetext is already created;
+ * return FALSE if the page contains no text
+ *
+ * the fonts are not requested if the format does not print them
+ */
+gboolean fetchpage(struct format *format, struct pagedata *data) {
+	data->text = pagetext_text(data->pagetext);
+	if (! data->text)
+		return FALSE;	/* no text in page */
+	if (format->faces != FACES_NONE) {
+		data->attrlist = pagetext_attributes(data->pagetext);
+		if (! data->attrlist)
+			return FALSE;	/* no text in page */
+	}
+	data->rects = pagetext_layout(data->pagetext, &data->nrects);
+	if (data->nrects == 0)
+		return FALSE;	/* no text in page */
+	if (data->attrlist != NULL)
+		data->styles = textstyles(data->attrlist);
+	return TRUE;
+}
+
+/*
+ * analyze a page: get its characters and find its blocks of text;
+ * return FALSE if the page contains no text
+ *
+ * if zone is not NULL, only the characters in it are analyzed, within its
+ * boundaries; the data does not refer to the page afterwards, so that it can
+ * be freed by a thread other than the one owning the document of the page
+ */
+gboolean analyzepage(PopplerPage *page, PopplerRectangle *zone,
+		int method, int order,
+		struct measure *measure, struct format *format,
+		struct pagedata *data) {
+	gboolean text;
+
+	memset(data, 0, sizeof(struct pagedata));
+	data->pagetext = pagetext_new(page);
+	text = fetchpage(format, data);
+	if (text) {
+		pagetext_zone(data->pagetext, zone);
+		text = textareapage(page, method, order, measure, data);
+	}
+	pagetext_release(data->pagetext);
+	return text;
+}
+
+/*
+ * free the data of a page
+ */
+void freepagedata(struct pagedata *data) {
+	pagetext_free(data->pagetext);
+	free(data->styles);
+	rectanglelist_free(data->textarea);
+	memset(data, 0, sizeof(struct pagedata));
+}
+
+/*
+ * pages read in advance, while looking for the main text zone: the state of
+ * page first + i is state[i], its data is data[i]; at most KEEPPAGES are kept,
+ * to bound memory, and none once memory is near the ceiling, if any; only
+ * their characters are kept, not the page nor its blocks of text
+ */
+#define KEEPPAGES 256
+
+#define KEPT_NONE 0
+#define KEPT_NOTEXT 1
+#define KEPT_TEXT 2
+
+struct keptpages {
+	int first, last;
+	int num;
+	char *state;
+	struct pagedata *data;
+};
+
+/*
+ * the analysis of a page: from the characters of the kept one if any,
+ * otherwise done now; the blocks of text of a kept page are found within the
+ * zone, if any, like for the others, so that the result does not depend on
+ * which pages were sampled
+ */
+gboolean takepage(struct keptpages *kept, PopplerDocument *doc, int npage,
+		PopplerRectangle *zone, int method, int order,
+		struct measure *measure, struct format *format,
+		struct pagedata *data) {
+	PopplerPage *page;
+	gboolean text;
+	int i;
+
+	if (kept != NULL && npage >= kept->first && npage <= kept->last) {
+		i = npage - kept->first;
+		if (kept->state[i] != KEPT_NONE) {
+			text = kept->state[i] == KEPT_TEXT;
+			*data = kept->data[i];
+			kept->state[i] = KEPT_NONE;
+			if (text) {
+				page = poppler_document_get_page(doc, npage);
+				pagetext_zone(data->pagetext, zone);
+				text = textareapage(page, method, order,
+					measure, data);
+				g_object_unref(page);
 			}
-			if (! rectangle_overlap(zone, &textarea->rect[r]))
-				continue;
-			rectangle_intersect(region, zone, &textarea->rect[r]);
-			showregion(fd, region, textarea,
-				text, attrlist, rects, nrects,
-				measure, format, scandata, FALSE);
+			return text;
 		}
-		poppler_rectangle_free(region);
+	}
+
+	page = poppler_document_get_page(doc, npage);
+	text = analyzepage(page, zone, method, order, measure, format, data);
+	g_object_unref(page);
+	return text;
+}
+
+/*
+ * the main text zone of a document, excluding headers and footers; the
+ * characters of the pages from first to last sampled for finding it are read
+ * once and for all and kept for the conversion; with a memory ceiling and the
+ * uri of the document, the pages are read on a copy of it that is reopened
+ * when memory is near the ceiling
+ */
+PopplerRectangle *mainzone(PopplerDocument *doc, char *uri, gdouble height,
+		struct measure *measure, struct format *format,
+		struct keptpages *kept) {
+	RectangleVector *frequent;
+	RectangleList *textarea, *recur;
+	PopplerRectangle *zone;
+	PopplerDocument *sample;
+	PopplerPage *page;
+	struct pagedata *data;
+	int npages, n, samplerate, iterations, i, used;
+	gboolean text;
+
+	debugfrequent = 0;
+	frequent = rectanglevector_create(30);
+	sample = rectanglevector_sampledocument(doc, uri);
+	used = 0;
+	npages = poppler_document_get_n_pages(doc);
+	samplerate = rectanglevector_samplerate(npages);
+	srandom(time(NULL));
+	iterations = 0;
+
+	for (n = 0; n < npages; n++) {
+		if (random() % 100 > samplerate)
+			continue;
+		iterations++;
+		pagetiming_page(n);
+		page = poppler_document_get_page(sample, n);
+
+		if (n < kept->first || n > kept->last ||
+		    kept->num >= KEEPPAGES || memory_near())
+			textarea = rectanglelist_textarea_distance(page,
+				measure->blockdistance);
+		else {
+			i = n - kept->first;
+			data = &kept->data[i];
+			memset(data, 0, sizeof(struct pagedata));
+			data->pagetext = pagetext_new(page);
+			text = fetchpage(format, data);
+			kept->state[i] = text ? KEPT_TEXT : KEPT_NOTEXT;
+			kept->num++;
+			textarea = rectanglelist_textarea_distance_pagetext(
+				data->pagetext, measure->blockdistance);
+			pagetext_release(data->pagetext);
+		}
+
+		rectanglevector_frequent_add(frequent, textarea, height, n);
+		rectanglelist_free(textarea);
+		g_object_unref(page);
+		pagetiming_endpage();
+		if (sample != doc)
+			sample = memory_recycle(sample, uri, &used);
+	}
+	if (sample != doc)
+		g_object_unref(sample);
+
+	recur = rectanglevector_frequent_list(frequent, iterations);
+	zone = rectanglevector_main(doc, recur, height,
+		measure->blockdistance);
+	rectanglelist_free(recur);
+	return zone;
+}
+
+/*
+ * free the pages analyzed in advance and not shown
+ */
+void keptpages_free(struct keptpages *kept) {
+	int i;
+
+	for (i = 0; i <= kept->last - kept->first; i++)
+		if (kept->state[i] != KEPT_NONE)
+			freepagedata(&kept->data[i]);
+	free(kept->state);
+	free(kept->data);
+}
+
+/*
+ * show the characters of an analyzed page
+ */
+void emitpage(struct textout *out, struct pagedata *data, gboolean text,
+		PopplerRectangle *zone, int method,
+		struct measure *measure, struct format *format,
+		struct scandata *scandata) {
+	gint64 timing;
+
+				/* initalize output font */
+
+	startpage(scandata);
+	if (! text)
+		return;
+
+				/* show text */
+
+	timing = pagetiming_now();
+	switch (method) {
+	case 0:
+		showregion_chars(out, zone, data->textarea,
+			data->text, data->attrlist, data->styles,
+			data->rects, data->nrects, NULL, NULL, 0,
+			measure, format, scandata, TRUE);
+		break;
+	case 1:
+	case 2:
+		showregion_chars(out, zone, data->textarea,
+			data->text, data->attrlist, data->styles,
+			data->rects, data->nrects, NULL, NULL, 0,
+			measure, format, scandata, FALSE);
+		break;
+	case 3:
+		showblocks(out, zone, data->textarea,
+			data->text, data->attrlist, data->styles,
+			data->rects, data->nrects,
+			measure, format, scandata, "");
 		break;
 	case 4:
 		measure->rightreturn = -1;
 		measure->indent = 100000;
 		measure->hyphen = '\0';
-		textarea = rectanglelist_rows(page, measure->blockdistance);
-		region = poppler_rectangle_new();
-		for (r = 0; r < textarea->num; r++) {
-			delement(fd, "[=== BLOCK %d]", r);
-			if (zone == NULL) {
-				showregion(fd, &textarea->rect[r], textarea,
-					text, attrlist, rects, nrects,
-					measure, format, scandata, FALSE);
-				fprintf(fd, "\n");
-				continue;
-			}
-			if (! rectangle_overlap(zone, &textarea->rect[r]))
-				continue;
-			rectangle_intersect(region, zone, &textarea->rect[r]);
-			showregion(fd, region, textarea,
-				text, attrlist, rects, nrects,
-				measure, format, scandata, FALSE);
-			fprintf(fd, "\n");
-		}
-		poppler_rectangle_free(region);
+		showblocks(out, zone, data->textarea,
+			data->text, data->attrlist, data->styles,
+			data->rects, data->nrects,
+			measure, format, scandata, "\n");
 		break;
-	default:
-		fprintf(stderr, "no such conversion method: %d\n", method);
-		exit(EXIT_FAILURE);
 	}
+	pagetiming_stage(STAGE_EMIT, timing, data->nrects);
+}
 
-	poppler_page_free_text_attributes(attrlist);
-	g_free(rects);
-	free(text);
+/*
+ * show the characters in a page
+ */
+void showpage(FILE *fd, PopplerPage *page, PopplerRectangle *zone,
+		int method, int order,
+		struct measure *measure, struct format *format,
+		struct scandata *scandata) {
+	struct pagedata data;
+	struct textout out = {NULL, 0, 0};
+	gboolean text;
+
+	if (! format->compiled)
+		formatcompile(format);
+	text = analyzepage(page, zone, method, order, measure, format, &data);
+	emitpage(&out, &data, text, zone, method, measure, format, scandata);
+	textout_flush(&out, fd);
+	textout_free(&out);
+	freepagedata(&data);
 }
 
 /*
@@ -539,7 +1069,7 @@ void startdocument(FILE *fd,
 	(void)fd;
 	(void)method;
 	(void)measure;
-	(void)format;
+	formatcompile(format);
 	scandata->newpar = FALSE;
 	scandata->prev = START;
 }
@@ -557,15 +1087,219 @@ void enddocument(FILE *fd,
 }
 
 /*
- * show some pages of a pdf document
+ * number of threads converting the pages of a file
  */
-void showdocumentpart(FILE *fd, PopplerDocument *doc, int first, int last,
+int textjobs = 1;
+
+/*
+ * parallel conversion of the pages of a file
+ *
+ * each worker thread opens the file by itself, since a poppler document
+ * cannot be used by two threads at the same time; it takes the next page to
+ * analyze, and shows it in a memory buffer, assuming that the previous page
+ * ends in the middle of a paragraph: newpar is FALSE and prev is a space; the
+ * only state that crosses the pages are these two fields of struct scandata,
+ * since startpage() resets the others; the main thread outputs the pages in
+ * order: the buffer if the state left by the previous page is the assumed
+ * one, otherwise it shows the page again from its data, which does not take
+ * long since all analysis is already done
+ *
+ * the workers are at most WINDOW pages per thread ahead of the output, so
+ * that the data of only that many pages is in memory at the same time; with a
+ * memory ceiling, each worker reopens its document when memory is near it
+ *
+ * a worker that cannot open the file tells the main thread, which stops the
+ * others and returns the first page not shown, for the caller to convert the
+ * rest by itself
+ */
+#define WINDOW 4
+
+struct pagejob {
+	int npage;
+	gboolean done;
+	struct pagedata data;
+	gboolean text;
+	struct scandata in;
+	struct scandata out;
+	struct textout buffer;
+};
+
+struct pagejobs {
+	char *uri;
+	int first, last;
+	PopplerRectangle *zone;
+	int method, order;
+	struct measure *measure;
+	struct format *format;
+	struct keptpages *kept;
+
+	GMutex mutex;
+	GCond cond;
+	int next;
+	int shown;
+	int window;
+	struct pagejob *job;
+	gboolean failed;
+};
+
+void *pagejobs_worker(void *arg) {
+	struct pagejobs *jobs = arg;
+	struct pagejob *job;
+	struct measure measure;
+	PopplerDocument *doc;
+	int npage, used;
+
+	doc = poppler_document_new_from_file(jobs->uri, NULL, NULL);
+	if (doc == NULL) {
+		g_mutex_lock(&jobs->mutex);
+		jobs->failed = TRUE;
+		g_cond_broadcast(&jobs->cond);
+		g_mutex_unlock(&jobs->mutex);
+		return NULL;
+	}
+	pagecache_document(doc);
+	used = 0;
+
+	while (TRUE) {
+		g_mutex_lock(&jobs->mutex);
+		while (jobs->next <= jobs->last &&
+		       jobs->next >= jobs->shown + jobs->window)
+			g_cond_wait(&jobs->cond, &jobs->mutex);
+		npage = jobs->next++;
+		g_mutex_unlock(&jobs->mutex);
+		if (npage > jobs->last)
+			break;
+
+		job = &jobs->job[(npage - jobs->first) % jobs->window];
+		job->npage = npage;
+		measure = *jobs->measure;
+		pagetiming_page(npage);
+		job->text = takepage(jobs->kept, doc, npage, jobs->zone,
+			jobs->method, jobs->order, &measure, jobs->format,
+			&job->data);
+
+		job->in.newpar = FALSE;
+		job->in.prev = npage == jobs->first ? START : ' ';
+		job->out = job->in;
+		delement(&job->buffer, "[PAGE %d]", npage);
+		emitpage(&job->buffer, &job->data, job->text,
+			jobs->zone, jobs->method,
+			&measure, jobs->format, &job->out);
+		pagetiming_endpage();
+		doc = memory_recycle(doc, jobs->uri, &used);
+
+		g_mutex_lock(&jobs->mutex);
+		job->done = TRUE;
+		g_cond_broadcast(&jobs->cond);
+		g_mutex_unlock(&jobs->mutex);
+	}
+
+	g_object_unref(doc);
+	return NULL;
+}
+
+int showpagesjobs(FILE *fd, char *uri, int first, int last,
+		PopplerRectangle *zone, struct keptpages *kept,
+		int method, int order,
+		struct measure *measure, struct format *format,
+		struct scandata *scandata) {
+	struct pagejobs jobs;
+	struct pagejob *job;
+	struct measure local;
+	GThread **thread;
+	int t, npage;
+
+	jobs.uri = uri;
+	jobs.first = first;
+	jobs.last = last;
+	jobs.zone = zone;
+	jobs.method = method;
+	jobs.order = order;
+	jobs.measure = measure;
+	jobs.format = format;
+	jobs.kept = kept;
+	g_mutex_init(&jobs.mutex);
+	g_cond_init(&jobs.cond);
+	jobs.next = first;
+	jobs.shown = first;
+	jobs.window = WINDOW * textjobs;
+	jobs.job = calloc(jobs.window, sizeof(struct pagejob));
+	jobs.failed = FALSE;
+
+	thread = malloc(textjobs * sizeof(GThread *));
+	for (t = 0; t < textjobs; t++)
+		thread[t] = g_thread_new("pdftext", pagejobs_worker, &jobs);
+
+	for (npage = first; npage <= last; npage++) {
+		job = &jobs.job[(npage - first) % jobs.window];
+		g_mutex_lock(&jobs.mutex);
+		while ((! job->done || job->npage != npage) && ! jobs.failed)
+			g_cond_wait(&jobs.cond, &jobs.mutex);
+		if (! job->done || job->npage != npage) {
+			jobs.next = last + 1;
+			g_cond_broadcast(&jobs.cond);
+			g_mutex_unlock(&jobs.mutex);
+			break;
+		}
+		g_mutex_unlock(&jobs.mutex);
+
+		if (job->in.newpar == scandata->newpar &&
+		    job->in.prev == scandata->prev)
+			*scandata = job->out;
+		else {
+			job->buffer.len = 0;
+			delement(&job->buffer, "[PAGE %d]", npage);
+			pagetiming_page(npage);
+			local = *measure;
+			emitpage(&job->buffer, &job->data, job->text,
+				zone, method, &local, format, scandata);
+			pagetiming_endpage();
+		}
+		textout_flush(&job->buffer, fd);
+		freepagedata(&job->data);
+
+		g_mutex_lock(&jobs.mutex);
+		job->done = FALSE;
+		jobs.shown++;
+		g_cond_broadcast(&jobs.cond);
+		g_mutex_unlock(&jobs.mutex);
+	}
+
+	for (t = 0; t < textjobs; t++)
+		g_thread_join(thread[t]);
+	free(thread);
+	for (t = 0; t < jobs.window; t++) {
+		if (jobs.job[t].done)
+			freepagedata(&jobs.job[t].data);
+		textout_free(&jobs.job[t].buffer);
+	}
+	free(jobs.job);
+	g_cond_clear(&jobs.cond);
+	g_mutex_clear(&jobs.mutex);
+	if (jobs.failed)
+		fprintf(stderr, "error opening file %s in a thread, "
+			"converting from page %d in this one\n",
+			uri, npage + 1);
+	return npage;
+}
+
+/*
+ * show some pages of a pdf document; with a file uri and textjobs > 1, they
+ * are converted by textjobs threads; also with a single one if there is a
+ * memory ceiling, so that the document can be reopened without affecting the
+ * caller
+ */
+void showdocumenturi(FILE *fd, PopplerDocument *doc, char *uri,
+		int first, int last,
 		PopplerRectangle *zone,
 		int method, int order,
 		struct measure *measure, struct format *format) {
 	struct scandata scandata;
+	struct pagedata data;
+	struct textout out = {NULL, 0, 0};
+	struct keptpages kept, *keptp = NULL;
+	gboolean text;
 	int npage;
-	PopplerPage *page;
 	gdouble h;
 
 	if (first < 0)
@@ -578,25 +1312,54 @@ void showdocumentpart(FILE *fd, PopplerDocument *doc, int first, int last,
 	if (last >= poppler_document_get_n_pages(doc))
 		last = poppler_document_get_n_pages(doc) - 1;
 
+	startdocument(fd, method, measure, format, &scandata);
+
 	if (zone != NULL && zone->x1 == -100 && zone->x2 == -100) {
 		h = zone->y2;
 		poppler_rectangle_free(zone);
-		debugfrequent = 0;
-		zone = rectanglevector_main(doc, NULL,
-			h, measure->blockdistance);
+		kept.first = first;
+		kept.last = last;
+		kept.num = 0;
+		kept.state = calloc(MAX(last - first + 1, 1), sizeof(char));
+		kept.data = calloc(MAX(last - first + 1, 1),
+			sizeof(struct pagedata));
+		keptp = &kept;
+		zone = mainzone(doc, uri, h, measure, format, keptp);
 	}
 
-	startdocument(fd, method, measure, format, &scandata);
-	for (npage = first; npage <= last; npage++) {
-		page = poppler_document_get_page(doc, npage);
-		delement(fd, "[PAGE %d]", npage);
-		showpage(fd, page, zone,
+	npage = first;
+	if (uri != NULL && (textjobs > 1 || memoryceiling > 0) &&
+	    first < last)
+		npage = showpagesjobs(fd, uri, first, last, zone, keptp,
 			method, order, measure, format, &scandata);
-		g_object_unref(page);
+	for (; npage <= last; npage++) {
+		pagetiming_page(npage);
+		text = takepage(keptp, doc, npage, zone,
+			method, order, measure, format, &data);
+		delement(&out, "[PAGE %d]", npage);
+		emitpage(&out, &data, text, zone, method,
+			measure, format, &scandata);
+		pagetiming_endpage();
+		textout_flush(&out, fd);
+		freepagedata(&data);
 	}
+	textout_free(&out);
+	if (keptp != NULL)
+		keptpages_free(keptp);
 	enddocument(fd, method, measure, format, &scandata);
 }
 
+/*
+ * show some pages of a pdf document
+ */
+void showdocumentpart(FILE *fd, PopplerDocument *doc, int first, int last,
+		PopplerRectangle *zone,
+		int method, int order,
+		struct measure *measure, struct format *format) {
+	showdocumenturi(fd, doc, NULL, first, last, zone,
+		method, order, measure, format);
+}
+
 /*
  * show a pdf document
  */
@@ -619,14 +1382,15 @@ void showfile(FILE *fd, char *filename, int first, int last,
 	uri = filenametouri(filename);
 
 	doc = poppler_document_new_from_file(uri, NULL, NULL);
-	free(uri);
 	if (doc == NULL) {
 		printf("error opening file %s\n", filename);
 		exit(EXIT_FAILURE);
 	}
+	pagecache_document(doc);
 
-	showdocumentpart(fd, doc, first, last, zone,
+	showdocumenturi(fd, doc, uri, first, last, zone,
 		method, order, measure, format);
+	free(uri);
 }
 
 /*
@@ -51,8 +51,25 @@ struct format {
 	char *less;
 	char *greater;
 	char *and;
+
+	char *escape[256];	/* replacement of each character, or NULL;
+				   computed from the above by formatcompile() */
+	int faces;		/* FACES_* of the nonempty font strings,
+				   computed by formatcompile() */
+	gboolean compiled;	/* set by formatcompile(), which is called by
+				   startdocument(), and by showpage() and
+				   showregion_chars() if not yet done */
 };
 
+/* the font strings used by a format: none, set face, begin/end face */
+#define FACES_NONE 0x00
+#define FACES_SET  0x01
+#define FACES_TAGS 0x02
+
+/* fill the table of replacements and the faces of a format; to be called
+ * again if the strings of the format are changed after it was first used */
+void formatcompile(struct format *format);
+
 /*
  * known output formats
  */
@@ -72,6 +89,22 @@ extern gboolean debugpar;
 /* data for processing the characters */
 struct scandata;
 
+/*
+ * output buffer, written to a file one page at time
+ */
+struct textout {
+	char *data;
+	size_t len;
+	size_t max;
+};
+
+void textout_write(struct textout *out, char *s, size_t n);
+void textout_puts(struct textout *out, char *s);
+void textout_putc(struct textout *out, char c);
+void textout_printf(struct textout *out, char *format, ...);
+void textout_flush(struct textout *out, FILE *fd);
+void textout_free(struct textout *out);
+
 /* start processing a document */
 void startdocument(FILE *fd,
 		int method, struct measure *measure, struct format *format,
@@ -87,6 +120,23 @@ void showregion(FILE *fd, PopplerRectangle *zone, RectangleList *textarea,
 		struct measure *measure, struct format *format,
 		struct scandata *scandata, gboolean detectcolumn);
 
+/* show only the characters of the given indexes in a box in a page */
+void showregion_chars(struct textout *out, PopplerRectangle *zone,
+		RectangleList *textarea,
+		char *text, GList *attrlist, guchar *styles,
+		PopplerRectangle *rects, guint nrects,
+		guint *offsets, gint *chars, gint nchars,
+		struct measure *measure, struct format *format,
+		struct scandata *scandata, gboolean detectcolumn);
+
+/* show the characters in each block of a page, in order */
+void showblocks(struct textout *out, PopplerRectangle *zone,
+		RectangleList *blocks,
+		char *text, GList *attrlist, guchar *styles,
+		PopplerRectangle *rects, guint nrects,
+		struct measure *measure, struct format *format,
+		struct scandata *scandata, char *after);
+
 /* show the characters in a page */
 void showpage(FILE *fd, PopplerPage *page,
 		PopplerRectangle *zone,
@@ -99,6 +149,16 @@ void enddocument(FILE *fd,
 		int method, struct measure *measure, struct format *format,
 		struct scandata *scandata);
 
+/* number of threads converting the pages of a file */
+extern int textjobs;
+
+/* show some pages of a pdf document, in textjobs threads if uri is not NULL */
+void showdocumenturi(FILE *fd, PopplerDocument *doc, char *uri,
+		int first, int last,
+		PopplerRectangle *zone,
+		int method, int order,
+		struct measure *measure, struct format *format);
+
 /* show some pages of a pdf document */
 void showdocumentpart(FILE *fd, PopplerDocument *doc, int first, int last,
 		PopplerRectangle *zone,
@@ -25,6 +25,9 @@
  *	-o ord	method for sorting: 0-2
  *	-d dis	minimal distance between blocks of text in the page
  *	-i n-m	page range
+ *	-j n	number of threads
+ *	-T fmt	report the time of each stage of the conversion (text or json)
+ *	-M mb	memory ceiling in megabytes
  *
  *
  * todo: see man page, section BUGS
@@ -52,6 +55,10 @@ int main(int argc, char *argv[]) {
 	format = &format_roff;
 	usage = FALSE;
 	opterr = FALSE;
+	if (! pagetiming_enable(NULL))
+		fprintf(stderr, "PDFTIMING is not text or json, ignored\n");
+	if (! memory_ceiling(NULL))
+		fprintf(stderr, "PDFMEMORY is not a size in MB, ignored\n");
 	while (argc > 1 && argv[1][0] == '-') {
 		switch(argv[1][1]) {
 		case 'r':
@@ -153,6 +160,38 @@ int main(int argc, char *argv[]) {
 			zone->x2 = -100;
 			zone->y2 = -1;
 			break;
+		case 'j':
+			if (argc - 1 < 2 || atoi(argv[2]) < 1) {
+				printf("-j requires a number of threads\n");
+				usage = TRUE;
+				opterr = TRUE;
+				break;
+			}
+			textjobs = atoi(argv[2]);
+			argc--;
+			argv++;
+			break;
+		case 'T':
+			if (argc - 1 < 2 || ! pagetiming_enable(argv[2])) {
+				printf("-T requires a report format ");
+				printf("(text or json)\n");
+				usage = TRUE;
+				opterr = TRUE;
+				break;
+			}
+			argc--;
+			argv++;
+			break;
+		case 'M':
+			if (argc - 1 < 2 || ! memory_ceiling(argv[2])) {
+				printf("-M requires a size in megabytes\n");
+				usage = TRUE;
+				opterr = TRUE;
+				break;
+			}
+			argc--;
+			argv++;
+			break;
 		case 'v':
 			debugpar = TRUE;
 			break;
@@ -173,7 +212,8 @@ int main(int argc, char *argv[]) {
 		printf("pdftoroff converts pdf to various text formats\n");
 		printf("usage:\n\tpdftoroff [-r|-w|-p|-f|-t|-s fmt]");
 		printf(" [-m method [-d dist] [-o order]]\n");
-		printf("\t          [-i range] [-b box] [-n] [-v] file.pdf\n");
+		printf("\t          [-i range] [-b box] [-n] [-j jobs] ");
+		printf("[-T format] [-M mb] [-v] file.pdf\n");
 		printf("\t\t-r\t\tconvert to roff (default)\n");
 		printf("\t\t-w\t\tconvert to html\n");
 		printf("\t\t-p\t\tconvert to plain TeX\n");
@@ -187,6 +227,9 @@ int main(int argc, char *argv[]) {
 		printf("\t\t-i range\tpages to convert (n:m)\n");
 		printf("\t\t-b box\t\tonly convert characters in box\n");
 		printf("\t\t-n\t\tdo not convert recurring elements\n");
+		printf("\t\t-j jobs\t\tnumber of threads\n");
+		printf("\t\t-T format\treport time of stages (text, json)\n");
+		printf("\t\t-M mb\t\tmemory ceiling in megabytes\n");
 		printf("\t\t-v\t\treason for line breaks\n");
 
 		exit(opterr || ! usage ? EXIT_FAILURE : EXIT_SUCCESS);
@@ -196,6 +239,8 @@ int main(int argc, char *argv[]) {
 
 	showfile(stdout, argv[1], first - 1, last - 1, zone,
 		method, order, &measure, format);
+	pagetiming_report(stderr);
+	memory_report(stderr);
 
 	return EXIT_SUCCESS;
 }